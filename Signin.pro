@@ -13,12 +13,70 @@ TEMPLATE = app
 
 
 SOURCES += main.cpp\
-        mainwindow.cpp
+        mainwindow.cpp\
+        dbconnection.cpp\
+        timesheet.cpp\
+        dbworker.cpp\
+        roster.cpp\
+        opensessions.cpp\
+        nfcreader.cpp\
+        libnfcreader.cpp\
+        fakenfcreader.cpp\
+        punchjournal.cpp\
+        usertotals.cpp\
+        outputmodel.cpp\
+        uieventqueue.cpp\
+        metrics.cpp\
+        readerpool.cpp\
+        punchprotocol.cpp\
+        punchserver.cpp\
+        punchclient.cpp\
+        daemon.cpp\
+        columnstore.cpp\
+        rollups.cpp\
+        snapshot.cpp\
+        migration.cpp\
+        swipereplay.cpp\
+        mysqlbackend.cpp\
+        sqlitebackend.cpp\
+        stallwatchdog.cpp
 
-HEADERS  += mainwindow.h
+HEADERS  += mainwindow.h\
+        dbconnection.h\
+        timesheet.h\
+        dbworker.h\
+        roster.h\
+        opensessions.h\
+        nfcreader.h\
+        libnfcreader.h\
+        fakenfcreader.h\
+        punchjournal.h\
+        usertotals.h\
+        outputmodel.h\
+        uieventqueue.h\
+        metrics.h\
+        readerpool.h\
+        punchprotocol.h\
+        punchserver.h\
+        punchclient.h\
+        daemon.h\
+        columnstore.h\
+        rollups.h\
+        snapshot.h\
+        migration.h\
+        swipereplay.h\
+        storagebackend.h\
+        mysqlbackend.h\
+        sqlitebackend.h\
+        stallwatchdog.h
 
 FORMS    += mainwindow.ui
 
-QT += sql
+QT += sql network
+
+LIBS += -lnfc
 
 QMAKE_CXXFLAGS += -std=c++0x
+
+# Lets GCC vectorize the ColumnStore kernels.
+QMAKE_CXXFLAGS += -ftree-vectorize
@@ -0,0 +1,484 @@
+#include "dbconnection.h"
+#include "dbworker.h"
+#include "timesheet.h"
+#include "roster.h"
+#include "opensessions.h"
+#include "punchjournal.h"
+#include "usertotals.h"
+#include "columnstore.h"
+#include "sqlitebackend.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <QtSql/QtSql>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Rows per INSERT while seeding.  Older SQLite allows at most 500 rows in one VALUES.
+static const int SEED_BATCH = 1000;
+static const int SQLITE_SEED_BATCH = 500;
+// First rfid handed out; user n gets RFID_BASE + n.
+static const qint64 RFID_BASE = 1000000000LL;
+
+/**
+ * @brief Command line settings for a run.
+ */
+struct BenchConfig
+{
+    QString host;
+    QString user;
+    QString password;
+    QString sqlite;
+    int users;
+    qint64 entries;
+    int iterations;
+    int reportRuns;
+    bool seed;
+    bool journal;
+};
+
+/**
+ * @brief Latencies of one operation, in nanoseconds.
+ */
+struct Samples
+{
+    QString name;
+    std::vector<qint64> nanos;
+    qint64 totalNanos;
+};
+
+static QTextStream out(stdout);
+
+static void usage()
+{
+    out << "usage: signin-bench --host H --user U --password P [options]\n"
+        << "       signin-bench --sqlite FILE [options]\n"
+        << "  Runs the punch path against a scratch MySQL database.  The database is\n"
+        << "  named after the user, as on the kiosk; its user and timesheet_entry\n"
+        << "  tables are DROPPED and reseeded unless --no-seed is given.  With\n"
+        << "  --sqlite the SQLite file is used instead, and deleted and reseeded.\n"
+        << "  --users N         roster size (default 1000)\n"
+        << "  --entries N       timesheet_entry rows of history (default 100000)\n"
+        << "  --iterations N    punches per operation (default 1000, at most --users)\n"
+        << "  --report-runs N   runs of each of 555, 1234 and 1111 (default 5)\n"
+        << "  --journal         journal punches and time the group commit separately\n"
+        << "  --no-seed         reuse the tables from the last run\n";
+    out.flush();
+}
+
+static bool parseArgs(const QStringList &args, BenchConfig &config)
+{
+    config.users = 1000;
+    config.entries = 100000;
+    config.iterations = 1000;
+    config.reportRuns = 5;
+    config.seed = true;
+    config.journal = false;
+
+    for(int i = 1; i < args.size(); i++)
+    {
+        QString arg = args[i];
+        if(arg == "--no-seed")
+        {
+            config.seed = false;
+            continue;
+        }
+
+        if(arg == "--journal")
+        {
+            config.journal = true;
+            continue;
+        }
+
+        // Everything else takes a value.
+        if(i + 1 >= args.size())
+            return false;
+        QString value = args[++i];
+
+        if(arg == "--host")
+            config.host = value;
+        else if(arg == "--user")
+            config.user = value;
+        else if(arg == "--password")
+            config.password = value;
+        else if(arg == "--sqlite")
+            config.sqlite = value;
+        else if(arg == "--users")
+            config.users = value.toInt();
+        else if(arg == "--entries")
+            config.entries = value.toLongLong();
+        else if(arg == "--iterations")
+            config.iterations = value.toInt();
+        else if(arg == "--report-runs")
+            config.reportRuns = value.toInt();
+        else
+            return false;
+    }
+
+    return (!config.sqlite.isEmpty() || (!config.host.isEmpty() && !config.user.isEmpty()))
+            && config.users > 0 && config.entries >= 0 && config.iterations > 0 && config.reportRuns > 0;
+}
+
+static bool exec(QSqlDatabase &db, const QString &sql)
+{
+    QSqlQuery query(db);
+    if(query.exec(sql))
+        return true;
+
+    out << "seed failed: " << query.lastError().text() << "\n" << sql.left(200) << "\n";
+    out.flush();
+    return false;
+}
+
+/**
+ * @brief seed recreate the tables with config.users users and config.entries closed
+ *        entries spread over the last two years.  A new SQLite file already has them,
+ *        created empty by the backend.
+ */
+static bool seed(QSqlDatabase &db, const BenchConfig &config)
+{
+    int batch = config.sqlite.isEmpty() ? SEED_BATCH : SQLITE_SEED_BATCH;
+    if(config.sqlite.isEmpty() && (!exec(db, "DROP TABLE IF EXISTS timesheet_entry")
+            || !exec(db, "DROP TABLE IF EXISTS user")
+            || !exec(db, "CREATE TABLE user (id INT PRIMARY KEY AUTO_INCREMENT, FirstName VARCHAR(64), LastName VARCHAR(64), rfid VARCHAR(32))")
+            || !exec(db, "CREATE TABLE timesheet_entry (id INT PRIMARY KEY AUTO_INCREMENT, userId INT, TimeIn DATETIME, TimeOut DATETIME)")))
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int first = 1; first <= config.users; first += batch)
+    {
+        QStringList rows;
+        for(int id = first; id < first + batch && id <= config.users; id++)
+        {
+            rows << QString("(%1, 'First%1', 'Last%2', '%3')").arg(id).arg(id % 997).arg(RFID_BASE + id);
+        }
+
+        if(!exec(db, "INSERT INTO user (id, FirstName, LastName, rfid) VALUES " + rows.join(",")))
+            return false;
+    }
+
+    QDateTime start = QDateTime::currentDateTime().addDays(-730);
+    start.setTime(QTime(0, 0));
+
+    db.transaction();
+    for(qint64 done = 0; done < config.entries; done += batch)
+    {
+        QStringList rows;
+        for(qint64 i = done; i < done + batch && i < config.entries; i++)
+        {
+            int userId = 1 + qrand() % config.users;
+            QDateTime in = start.addSecs((qrand() % 729) * 86400 + 8 * 3600 + qrand() % 36000);
+            QDateTime timeOut = in.addSecs(600 + qrand() % 14400);
+            rows << QString("(%1, '%2', '%3')").arg(userId)
+                    .arg(in.toString("yyyy-MM-dd hh:mm:ss"))
+                    .arg(timeOut.toString("yyyy-MM-dd hh:mm:ss"));
+        }
+
+        if(!exec(db, "INSERT INTO timesheet_entry (userId, TimeIn, TimeOut) VALUES " + rows.join(",")))
+        {
+            db.rollback();
+            return false;
+        }
+
+        if((done / batch) % 100 == 99)
+        {
+            db.commit();
+            db.transaction();
+        }
+    }
+    db.commit();
+
+    out << "seeded " << config.users << " users and " << config.entries << " entries in "
+        << timer.elapsed() / 1000.0 << " s\n";
+    out.flush();
+    return true;
+}
+
+static void report(Samples &s)
+{
+    if(s.nanos.empty())
+        return;
+
+    std::sort(s.nanos.begin(), s.nanos.end());
+    int n = (int)s.nanos.size();
+    double p50 = s.nanos[n * 50 / 100] / 1000.0;
+    double p99 = s.nanos[qMin(n - 1, n * 99 / 100)] / 1000.0;
+    double perSecond = s.totalNanos > 0 ? n * 1e9 / s.totalNanos : 0;
+
+    out << QString("%1 %2 %3 %4 %5\n")
+           .arg(s.name, -14)
+           .arg(n, 8)
+           .arg(p50, 12, 'f', 1)
+           .arg(p99, 12, 'f', 1)
+           .arg(perSecond, 12, 'f', 1);
+    out.flush();
+}
+
+/**
+ * @brief runJob time one DbWorker job, the same path the keypad takes minus the widgets.
+ */
+static void runJob(DbWorker &worker, Samples &s, DbJob::Type type, int userId)
+{
+    DbJob job;
+    job.type = type;
+    job.userId = userId;
+    job.serial = 0;
+    job.reader = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    DbResult result = worker.run(job);
+    qint64 nanos = timer.nsecsElapsed();
+
+    if(!result.success)
+    {
+        out << s.name << " failed for user " << userId << ": " << result.lines.join(" / ") << "\n";
+        out.flush();
+    }
+
+    s.nanos.push_back(nanos);
+    s.totalNanos += nanos;
+}
+
+/**
+ * @brief timeHistory time Timesheet::history, without the DbWorker and its caches.
+ */
+static void timeHistory(Timesheet &timesheet, Samples &s, int userId)
+{
+    UserStats stats;
+    QElapsedTimer timer;
+    timer.start();
+    Timesheet::Result r = timesheet.history(userId, stats);
+    qint64 nanos = timer.nsecsElapsed();
+    if(r != Timesheet::Ok)
+        out << s.name << " failed for user " << userId << "\n";
+
+    s.nanos.push_back(nanos);
+    s.totalNanos += nanos;
+}
+
+/**
+ * @brief timeAllStats time Timesheet::allStats, the 555 report.
+ */
+static void timeAllStats(Timesheet &timesheet, Samples &s)
+{
+    QList<UserStats> stats;
+    QElapsedTimer timer;
+    timer.start();
+    Timesheet::Result r = timesheet.allStats(stats);
+    qint64 nanos = timer.nsecsElapsed();
+    if(r != Timesheet::Ok)
+        out << s.name << " failed\n";
+
+    s.nanos.push_back(nanos);
+    s.totalNanos += nanos;
+}
+
+static Samples samples(const QString &name)
+{
+    Samples s;
+    s.name = name;
+    s.totalNanos = 0;
+    return s;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    BenchConfig config;
+    if(!parseArgs(app.arguments(), config))
+    {
+        usage();
+        return 2;
+    }
+
+    config.iterations = qMin(config.iterations, config.users);
+    qsrand(12345);
+
+    if(config.sqlite.isEmpty())
+    {
+        DbConnection::configure(config.host, config.user, config.password);
+    }
+    else
+    {
+        if(config.seed)
+        {
+            QFile::remove(config.sqlite);
+            QFile::remove(config.sqlite + "-wal");
+            QFile::remove(config.sqlite + "-shm");
+        }
+
+        DbConnection::setBackend(new SqliteBackend(config.sqlite));
+    }
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+    {
+        out << "could not connect: " << db.lastError().text() << "\n";
+        return 1;
+    }
+
+    if(config.seed && !seed(db, config))
+        return 1;
+
+    Roster roster;
+    OpenSessions sessions;
+    UserTotals totals;
+
+    QString journalPath = QDir::temp().filePath("signin-bench-journal");
+    QFile::remove(journalPath);
+    QFile::remove(journalPath + ".done");
+    PunchJournal journal(journalPath, PunchJournal::SyncEveryPunch);
+    if(config.journal && !journal.open())
+    {
+        out << journal.lastError() << "\n";
+        return 1;
+    }
+
+    PunchJournal *punchJournal = config.journal ? &journal : 0;
+    DbWorker worker(&roster, &sessions, punchJournal, &totals);
+    Timesheet timesheet(&roster, &sessions, punchJournal, &totals);
+
+    QElapsedTimer loadTimer;
+    loadTimer.start();
+    worker.start();
+    out << "caches loaded in " << loadTimer.elapsed() << " ms\n\n";
+
+    // The first iterations users, in a random order.
+    QList<int> ids;
+    for(int id = 1; id <= config.iterations; id++)
+    {
+        ids.append(id);
+    }
+    for(int i = ids.size() - 1; i > 0; i--)
+    {
+        ids.swap(i, qrand() % (i + 1));
+    }
+
+    out << QString("%1 %2 %3 %4 %5\n").arg("operation", -14).arg("ops", 8).arg("p50 us", 12).arg("p99 us", 12).arg("ops/s", 12);
+
+    Samples swipe = samples("swipe");
+    for(int i = 0; i < ids.size(); i++)
+    {
+        UserInfo user;
+        QElapsedTimer timer;
+        timer.start();
+        Timesheet::Result r = timesheet.findUserByRfid(QString::number(RFID_BASE + ids[i]), user);
+        qint64 nanos = timer.nsecsElapsed();
+        if(r != Timesheet::Ok)
+            out << "swipe failed for user " << ids[i] << "\n";
+
+        swipe.nanos.push_back(nanos);
+        swipe.totalNanos += nanos;
+    }
+    report(swipe);
+
+    Samples signIn = samples("sign in");
+    for(int i = 0; i < ids.size(); i++)
+    {
+        runJob(worker, signIn, DbJob::SignIn, ids[i]);
+    }
+    report(signIn);
+
+    if(config.journal)
+    {
+        Samples commit = samples("group commit");
+        QElapsedTimer timer;
+        timer.start();
+        timesheet.replayJournal(100);
+        commit.nanos.push_back(timer.nsecsElapsed());
+        commit.totalNanos = commit.nanos.back();
+        out << "(" << ids.size() << " sign ins in one replay)\n";
+        report(commit);
+    }
+
+    Samples status = samples("status");
+    for(int i = 0; i < ids.size(); i++)
+    {
+        runJob(worker, status, DbJob::Status, ids[i]);
+    }
+    report(status);
+
+    Samples signOut = samples("sign out");
+    for(int i = 0; i < ids.size(); i++)
+    {
+        runJob(worker, signOut, DbJob::SignOut, ids[i]);
+    }
+    report(signOut);
+
+    if(config.journal)
+    {
+        Samples commit = samples("group commit");
+        QElapsedTimer timer;
+        timer.start();
+        timesheet.replayJournal(100);
+        commit.nanos.push_back(timer.nsecsElapsed());
+        commit.totalNanos = commit.nanos.back();
+        out << "(" << ids.size() << " sign outs in one replay)\n";
+        report(commit);
+    }
+
+    Samples history = samples("history");
+    for(int i = 0; i < ids.size(); i++)
+    {
+        runJob(worker, history, DbJob::History, ids[i]);
+    }
+    report(history);
+
+    Samples allStats = samples("555 report");
+    Samples current = samples("1234 report");
+    Samples userIds = samples("1111 report");
+    for(int i = 0; i < config.reportRuns; i++)
+    {
+        runJob(worker, allStats, DbJob::AllStats, -1);
+        runJob(worker, current, DbJob::CurrentSignIns, -1);
+        runJob(worker, userIds, DbJob::ListUsers, -1);
+    }
+    report(allStats);
+    report(current);
+    report(userIds);
+
+    // The column copy against the queries it stands in for.
+    ColumnStore columns;
+    Samples columnLoad = samples("column load");
+    QElapsedTimer columnTimer;
+    columnTimer.start();
+    columns.reload();
+    columnLoad.nanos.push_back(columnTimer.nsecsElapsed());
+    columnLoad.totalNanos = columnLoad.nanos.back();
+    out << "(" << columns.size() << " entries in the column copy)\n";
+    report(columnLoad);
+
+    Timesheet bySql(&roster);
+    Timesheet byColumns(&roster, 0, 0, 0, &columns);
+
+    Samples historySql = samples("history sql");
+    Samples historyColumns = samples("history cols");
+    for(int i = 0; i < ids.size(); i++)
+    {
+        timeHistory(bySql, historySql, ids[i]);
+        timeHistory(byColumns, historyColumns, ids[i]);
+    }
+    report(historySql);
+    report(historyColumns);
+
+    Samples statsSql = samples("555 sql");
+    Samples statsColumns = samples("555 cols");
+    for(int i = 0; i < config.reportRuns; i++)
+    {
+        timeAllStats(bySql, statsSql);
+        timeAllStats(byColumns, statsColumns);
+    }
+    report(statsSql);
+    report(statsColumns);
+
+    QFile::remove(journalPath);
+    QFile::remove(journalPath + ".done");
+    return 0;
+}
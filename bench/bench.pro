@@ -0,0 +1,49 @@
+#-------------------------------------------------
+#
+# Headless benchmark of the punch path.  Builds the timeclock's database code
+# without the GUI or the NFC reader; see the README.
+#
+#-------------------------------------------------
+
+QT       += core sql
+QT       -= gui
+
+TARGET = signin-bench
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += bench.cpp\
+        ../dbconnection.cpp\
+        ../timesheet.cpp\
+        ../dbworker.cpp\
+        ../roster.cpp\
+        ../opensessions.cpp\
+        ../punchjournal.cpp\
+        ../usertotals.cpp\
+        ../metrics.cpp\
+        ../columnstore.cpp\
+        ../rollups.cpp\
+        ../mysqlbackend.cpp\
+        ../sqlitebackend.cpp
+
+HEADERS  += ../dbconnection.h\
+        ../timesheet.h\
+        ../dbworker.h\
+        ../roster.h\
+        ../opensessions.h\
+        ../punchjournal.h\
+        ../usertotals.h\
+        ../metrics.h\
+        ../columnstore.h\
+        ../rollups.h\
+        ../storagebackend.h\
+        ../mysqlbackend.h\
+        ../sqlitebackend.h
+
+QMAKE_CXXFLAGS += -std=c++0x
+
+# Lets GCC vectorize the ColumnStore kernels.
+QMAKE_CXXFLAGS += -ftree-vectorize
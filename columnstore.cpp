@@ -0,0 +1,447 @@
+#include "columnstore.h"
+#include "dbconnection.h"
+#include <QtSql/QtSql>
+#include <algorithm>
+#include <climits>
+
+// Rows read per query while loading.
+static const int PAGE_ROWS = 20000;
+// Unsorted rows allowed after the sorted ones before everything is re-sorted.
+static const int DELTA_MAX = 4096;
+// Open entries checked for a sign out per query.
+static const int CLOSED_BATCH = 500;
+
+// Times as wall clock seconds since 1970, like TIMESTAMPDIFF, so durations match the
+// SQL reports exactly, daylight saving changes included.  A NULL TimeOut reads as 0,
+// which counts as never signed out.  The seconds are spelled as the storage backend
+// needs through epochSeconds().
+static const char *ROWS_PAGE_SQL =
+        "SELECT id, userId, %1, %2"
+        " FROM timesheet_entry WHERE id>? ORDER BY id LIMIT 20000";
+static const char *CLOSED_SQL =
+        "SELECT id, %1"
+        " FROM timesheet_entry WHERE TimeOut>TimeIn AND id IN (%2)";
+
+static QString epochSeconds(const QString &column)
+{
+    return DbConnection::backend()->secondsBetween("'1970-01-01'", column);
+}
+
+ColumnStore::ColumnStore() :
+    loaded(false),
+    maxId(INT_MIN),
+    sortedRows(0)
+{
+}
+
+bool ColumnStore::isLoaded()
+{
+    QReadLocker locker(&lock);
+    return loaded;
+}
+
+int ColumnStore::size()
+{
+    QReadLocker locker(&lock);
+    return (int)rows.ids.size();
+}
+
+/**
+ * @brief ColumnStore::toColumnTime the column representation of a local time.
+ */
+qint64 ColumnStore::toColumnTime(const QDateTime &when)
+{
+    QDateTime wall(when.date(), when.time(), Qt::UTC);
+    return wall.toMSecsSinceEpoch() / 1000;
+}
+
+/**
+ * @brief ColumnStore::sumColumns total n entries: the seconds of the ones signed out
+ *        after they were signed in, and how many there were.  The rest were never
+ *        signed out.  No branches in the loop, so it vectorizes.
+ */
+void ColumnStore::sumColumns(const qint64 *timeIn, const qint64 *timeOut, int n, qint64 &seconds, int &completed)
+{
+    qint64 sum = 0;
+    qint64 count = 0;
+    for(int i = 0; i < n; i++)
+    {
+        qint64 d = timeOut[i] - timeIn[i];
+        qint64 closed = d > 0;
+        sum += d & -closed;
+        count += closed;
+    }
+
+    seconds = sum;
+    completed = (int)count;
+}
+
+/**
+ * @brief ColumnStore::reload replace the copy with the whole table.
+ * @return false if the database could not be reached.
+ */
+bool ColumnStore::reload()
+{
+    QMutexLocker refreshing(&refreshLock);
+
+    Rows fresh;
+    if(!fetchRows(INT_MIN, fresh))
+        return false;
+
+    QWriteLocker locker(&lock);
+    rows.ids.swap(fresh.ids);
+    rows.users.swap(fresh.users);
+    rows.timeIn.swap(fresh.timeIn);
+    rows.timeOut.swap(fresh.timeOut);
+
+    maxId = INT_MIN;
+    for(size_t i = 0; i < rows.ids.size(); i++)
+    {
+        maxId = qMax(maxId, (int)rows.ids[i]);
+    }
+
+    sortLocked();
+    loaded = true;
+    return true;
+}
+
+/**
+ * @brief ColumnStore::refresh pick up the entries added and the open entries closed
+ *        since the last refresh.  Loads everything the first time.
+ * @return false if the database could not be reached.
+ */
+bool ColumnStore::refresh()
+{
+    if(!isLoaded())
+        return reload();
+
+    QMutexLocker refreshing(&refreshLock);
+
+    int after;
+    QList<int> open;
+    {
+        QReadLocker locker(&lock);
+        after = maxId;
+        open = openToday.keys();
+    }
+
+    Rows added;
+    if(!fetchRows(after, added))
+        return false;
+
+    QHash<int, qint64> closed;
+    if(!open.isEmpty() && !fetchClosed(open, closed))
+        return false;
+
+    QWriteLocker locker(&lock);
+    for(QHash<int, qint64>::const_iterator it = closed.constBegin(); it != closed.constEnd(); ++it)
+    {
+        QHash<int, int>::iterator row = openToday.find(it.key());
+        if(row == openToday.end())
+            continue;
+
+        rows.timeOut[row.value()] = it.value();
+        openToday.erase(row);
+    }
+
+    // Yesterday's open entries can no longer be signed out from the kiosk.
+    qint64 today = toColumnTime(QDateTime(QDate::currentDate()));
+    QHash<int, int>::iterator it = openToday.begin();
+    while(it != openToday.end())
+    {
+        if(rows.timeIn[it.value()] < today)
+            it = openToday.erase(it);
+        else
+            ++it;
+    }
+
+    appendLocked(added);
+    if((int)rows.ids.size() - sortedRows > DELTA_MAX)
+        sortLocked();
+
+    return true;
+}
+
+/**
+ * @brief ColumnStore::userTotal a user's lifetime totals.
+ * @return false if the store is not loaded.
+ */
+bool ColumnStore::userTotal(int userId, UserTotal &total)
+{
+    return rangeTotal(userId, LLONG_MIN, LLONG_MAX, total);
+}
+
+/**
+ * @brief ColumnStore::rangeTotal a user's totals over the entries signed in from
+ *        from up to, not including, to (see toColumnTime()).
+ * @return false if the store is not loaded.
+ */
+bool ColumnStore::rangeTotal(int userId, qint64 from, qint64 to, UserTotal &total)
+{
+    QReadLocker locker(&lock);
+    if(!loaded)
+        return false;
+
+    total.userId = userId;
+    total.seconds = 0;
+    total.completed = 0;
+    total.unclosed = 0;
+
+    QHash<int, int>::const_iterator seg = segmentOf.constFind(userId);
+    if(seg != segmentOf.constEnd())
+    {
+        const Segment &s = segments[seg.value()];
+        const qint64 *in = &rows.timeIn[0];
+        int begin = std::lower_bound(in + s.begin, in + s.end, from) - in;
+        int end = std::lower_bound(in + begin, in + s.end, to) - in;
+
+        sumColumns(in + begin, &rows.timeOut[0] + begin, end - begin, total.seconds, total.completed);
+        total.unclosed = end - begin - total.completed;
+    }
+
+    addDeltaLocked(userId, from, to, total);
+    return true;
+}
+
+/**
+ * @brief ColumnStore::allTotals every user's lifetime totals.  Users without entries
+ *        are left out.
+ */
+QList<UserTotal> ColumnStore::allTotals()
+{
+    QReadLocker locker(&lock);
+    QList<UserTotal> list;
+    QHash<int, int> index;
+    list.reserve((int)segments.size());
+
+    for(size_t i = 0; i < segments.size(); i++)
+    {
+        const Segment &s = segments[i];
+        UserTotal total;
+        total.userId = s.userId;
+        sumColumns(&rows.timeIn[s.begin], &rows.timeOut[s.begin], s.end - s.begin, total.seconds, total.completed);
+        total.unclosed = s.end - s.begin - total.completed;
+        index.insert(s.userId, list.size());
+        list.append(total);
+    }
+
+    for(int i = sortedRows; i < (int)rows.ids.size(); i++)
+    {
+        int userId = rows.users[i];
+        if(!index.contains(userId))
+        {
+            UserTotal none;
+            none.userId = userId;
+            none.seconds = 0;
+            none.completed = 0;
+            none.unclosed = 0;
+            index.insert(userId, list.size());
+            list.append(none);
+        }
+
+        UserTotal &total = list[index.value(userId)];
+        qint64 d = rows.timeOut[i] - rows.timeIn[i];
+        if(d > 0)
+        {
+            total.seconds += d;
+            total.completed++;
+        }
+        else
+        {
+            total.unclosed++;
+        }
+    }
+
+    return list;
+}
+
+void ColumnStore::addDeltaLocked(int userId, qint64 from, qint64 to, UserTotal &total)
+{
+    for(int i = sortedRows; i < (int)rows.ids.size(); i++)
+    {
+        if(rows.users[i] != userId || rows.timeIn[i] < from || rows.timeIn[i] >= to)
+            continue;
+
+        qint64 d = rows.timeOut[i] - rows.timeIn[i];
+        if(d > 0)
+        {
+            total.seconds += d;
+            total.completed++;
+        }
+        else
+        {
+            total.unclosed++;
+        }
+    }
+}
+
+bool ColumnStore::fetchRows(int afterId, Rows &fetched)
+{
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return false;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if(!query.prepare(QString(ROWS_PAGE_SQL).arg(epochSeconds("TimeIn"), epochSeconds("TimeOut"))))
+    {
+        DbConnection::reportError(db);
+        return false;
+    }
+
+    for(;;)
+    {
+        query.bindValue(0, afterId);
+        if(!query.exec())
+        {
+            DbConnection::reportError(db);
+            return false;
+        }
+
+        int count = 0;
+        while(query.next())
+        {
+            afterId = query.value(0).toInt();
+            fetched.ids.push_back(afterId);
+            fetched.users.push_back(query.value(1).toInt());
+            fetched.timeIn.push_back(query.value(2).toLongLong());
+            fetched.timeOut.push_back(query.value(3).toLongLong());
+            count++;
+        }
+
+        query.finish();
+        if(count < PAGE_ROWS)
+            return true;
+    }
+}
+
+bool ColumnStore::fetchClosed(const QList<int> &ids, QHash<int, qint64> &closed)
+{
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return false;
+
+    for(int first = 0; first < ids.size(); first += CLOSED_BATCH)
+    {
+        QStringList list;
+        for(int i = first; i < ids.size() && i < first + CLOSED_BATCH; i++)
+        {
+            list << QString::number(ids[i]);
+        }
+
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        if(!query.exec(QString(CLOSED_SQL).arg(epochSeconds("TimeOut"), list.join(","))))
+        {
+            DbConnection::reportError(db);
+            return false;
+        }
+
+        while(query.next())
+        {
+            closed.insert(query.value(0).toInt(), query.value(1).toLongLong());
+        }
+    }
+
+    return true;
+}
+
+void ColumnStore::appendLocked(const Rows &added)
+{
+    qint64 today = toColumnTime(QDateTime(QDate::currentDate()));
+    for(size_t i = 0; i < added.ids.size(); i++)
+    {
+        rows.ids.push_back(added.ids[i]);
+        rows.users.push_back(added.users[i]);
+        rows.timeIn.push_back(added.timeIn[i]);
+        rows.timeOut.push_back(added.timeOut[i]);
+        maxId = qMax(maxId, (int)added.ids[i]);
+
+        if(added.timeIn[i] >= today && added.timeOut[i] <= added.timeIn[i])
+            openToday.insert(added.ids[i], (int)rows.ids.size() - 1);
+    }
+}
+
+/**
+ * @brief Orders row numbers by user, then TimeIn, then entry id.
+ */
+struct ColumnStore::RowOrder
+{
+    explicit RowOrder(const Rows &rows) : rows(rows) {}
+
+    bool operator()(int a, int b) const
+    {
+        if(rows.users[a] != rows.users[b])
+            return rows.users[a] < rows.users[b];
+        if(rows.timeIn[a] != rows.timeIn[b])
+            return rows.timeIn[a] < rows.timeIn[b];
+        return rows.ids[a] < rows.ids[b];
+    }
+
+    const Rows &rows;
+};
+
+/**
+ * @brief ColumnStore::sortLocked sort every row by user and TimeIn and rebuild the
+ *        user slices and the open entry index.
+ */
+void ColumnStore::sortLocked()
+{
+    int n = (int)rows.ids.size();
+    std::vector<int> order(n);
+    for(int i = 0; i < n; i++)
+    {
+        order[i] = i;
+    }
+
+    std::sort(order.begin(), order.end(), RowOrder(rows));
+
+    Rows sorted;
+    sorted.ids.resize(n);
+    sorted.users.resize(n);
+    sorted.timeIn.resize(n);
+    sorted.timeOut.resize(n);
+    for(int i = 0; i < n; i++)
+    {
+        sorted.ids[i] = rows.ids[order[i]];
+        sorted.users[i] = rows.users[order[i]];
+        sorted.timeIn[i] = rows.timeIn[order[i]];
+        sorted.timeOut[i] = rows.timeOut[order[i]];
+    }
+
+    rows.ids.swap(sorted.ids);
+    rows.users.swap(sorted.users);
+    rows.timeIn.swap(sorted.timeIn);
+    rows.timeOut.swap(sorted.timeOut);
+    sortedRows = n;
+
+    segments.clear();
+    segmentOf.clear();
+    for(int i = 0; i < n; i++)
+    {
+        if(segments.empty() || segments.back().userId != rows.users[i])
+        {
+            Segment s;
+            s.userId = rows.users[i];
+            s.begin = i;
+            s.end = i;
+            segmentOf.insert(s.userId, (int)segments.size());
+            segments.push_back(s);
+        }
+
+        segments.back().end = i + 1;
+    }
+
+    indexOpenLocked();
+}
+
+void ColumnStore::indexOpenLocked()
+{
+    openToday.clear();
+    qint64 today = toColumnTime(QDateTime(QDate::currentDate()));
+    for(int i = 0; i < (int)rows.ids.size(); i++)
+    {
+        if(rows.timeIn[i] >= today && rows.timeOut[i] <= rows.timeIn[i])
+            openToday.insert(rows.ids[i], i);
+    }
+}
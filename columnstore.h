@@ -0,0 +1,82 @@
+#ifndef COLUMNSTORE_H
+#define COLUMNSTORE_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <vector>
+#include "timesheet.h"
+
+/**
+ * @brief The ColumnStore class is an optional in-memory copy of timesheet_entry laid out
+ *        as columns: user id, TimeIn and TimeOut each in one contiguous array, with the
+ *        times as seconds since 1970 on the wall clock (the same arithmetic as MySQL's
+ *        TIMESTAMPDIFF).  Rows are sorted by user and TimeIn, so one user's entries, or
+ *        the ones in a range of days, are one slice of each array, and totals are a
+ *        branch-free pass over the slice that the compiler can vectorize.
+ *
+ *        reload() reads the whole table in pages.  refresh() is cheap: it appends the
+ *        rows added since, and picks up the sign outs of today's open entries, which is
+ *        everything the punch path changes.  New rows are kept unsorted after the sorted
+ *        part until there are DELTA_MAX of them, then everything is re-sorted.  Rows
+ *        edited or deleted by hand are only seen after the next reload().
+ *
+ *        Safe to use from any thread; refresh() and reload() use the calling thread's
+ *        DbConnection.
+ */
+class ColumnStore
+{
+public:
+    ColumnStore();
+
+    bool isLoaded();
+    int size();
+    bool reload();
+    bool refresh();
+
+    bool userTotal(int userId, UserTotal &total);
+    bool rangeTotal(int userId, qint64 from, qint64 to, UserTotal &total);
+    QList<UserTotal> allTotals();
+
+    static qint64 toColumnTime(const QDateTime &when);
+    static void sumColumns(const qint64 *timeIn, const qint64 *timeOut, int n, qint64 &seconds, int &completed);
+
+private:
+    struct Segment
+    {
+        int userId;
+        int begin;
+        int end;
+    };
+
+    struct Rows
+    {
+        std::vector<qint32> ids;
+        std::vector<qint32> users;
+        std::vector<qint64> timeIn;
+        std::vector<qint64> timeOut;
+    };
+
+    struct RowOrder;
+
+    bool fetchRows(int afterId, Rows &fetched);
+    bool fetchClosed(const QList<int> &ids, QHash<int, qint64> &closed);
+    void appendLocked(const Rows &added);
+    void sortLocked();
+    void indexOpenLocked();
+    void addDeltaLocked(int userId, qint64 from, qint64 to, UserTotal &total);
+
+    QMutex refreshLock;     // one refresh or reload at a time.
+    QReadWriteLock lock;
+    bool loaded;
+    int maxId;
+    int sortedRows;         // rows [0, sortedRows) are sorted; the rest are in id order.
+    Rows rows;
+    std::vector<Segment> segments;
+    QHash<int, int> segmentOf;      // user id -> index into segments.
+    QHash<int, int> openToday;      // entry id -> row, for entries signed in today and still open.
+};
+
+#endif // COLUMNSTORE_H
@@ -0,0 +1,228 @@
+#include "daemon.h"
+#include "metrics.h"
+#include "columnstore.h"
+#include "rollups.h"
+#include "opensessions.h"
+#include "punchclient.h"
+#include "punchjournal.h"
+#include "punchserver.h"
+#include "roster.h"
+#include "usertotals.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+
+// Where kiosks find the daemon when it is given no address.
+static const char *DEFAULT_SOCKET = "/tmp/signin-punch.sock";
+// The daemon's own journal, apart from any kiosk's on the same machine.
+static const char *DEFAULT_JOURNAL = "/home/pi/.signin_daemon_journal";
+// How often the metrics file is rewritten, as on the kiosk.
+static const int METRICS_INTERVAL_MS = 10000;
+
+/**
+ * @brief optionValue the argument after name, or fallback if it is not given.
+ */
+static QString optionValue(const QStringList &args, const QString &name, const QString &fallback = QString())
+{
+    int i = args.indexOf(name);
+    if(i < 0 || i + 1 >= args.size())
+        return fallback;
+
+    return args[i + 1];
+}
+
+int runDaemon(const QStringList &args)
+{
+    QTextStream err(stderr);
+
+    QString port = optionValue(args, "--listen");
+    QString socketPath = optionValue(args, "--socket");
+    if(port.isEmpty() && socketPath.isEmpty())
+        socketPath = DEFAULT_SOCKET;
+
+    // SIGNIN_METRICS_FILE turns on the metrics file.
+    QString metricsPath = QString::fromLocal8Bit(qgetenv("SIGNIN_METRICS_FILE"));
+    MetricsWriter *metrics = 0;
+    if(!metricsPath.isEmpty())
+        metrics = new MetricsWriter(metricsPath, METRICS_INTERVAL_MS);
+
+    // One copy of the caches for every kiosk.
+    Roster roster;
+    OpenSessions sessions;
+    UserTotals totals;
+    ColumnStore columnStore;
+    ColumnStore *columns = qgetenv("SIGNIN_COLUMN_STORE") == "1" ? &columnStore : NULL;
+    Rollups rollups;
+
+    PunchJournal journal(optionValue(args, "--journal", DEFAULT_JOURNAL));
+    bool journalOk = journal.open();
+    if(!journalOk)
+        err << journal.lastError() << " Punches will be written directly.\n";
+
+    // Punches, status and history go through one worker so they are decided in order;
+    // the reports get a second connection, and are never stuck behind a group commit.
+    QThread punchThread;
+    DbWorker *punches = new DbWorker(&roster, &sessions, journalOk ? &journal : NULL, &totals, columns, &rollups);
+    punches->moveToThread(&punchThread);
+    QObject::connect(&punchThread, SIGNAL(started()), punches, SLOT(start()));
+    QObject::connect(&punchThread, SIGNAL(finished()), punches, SLOT(deleteLater()));
+
+    QThread reportThread;
+    DbWorker *reports = new DbWorker(&roster, &sessions, NULL, &totals, columns, &rollups);
+    // Only to see which punches are still on their way to the database.
+    reports->setSharedJournal(journalOk ? &journal : NULL);
+    reports->moveToThread(&reportThread);
+    QObject::connect(&reportThread, SIGNAL(finished()), reports, SLOT(deleteLater()));
+
+    PunchServer server(punches, reports);
+    if(!port.isEmpty() && !server.listenTcp(port.toUShort()))
+    {
+        err << server.lastError() << "\n";
+        return 1;
+    }
+
+    if(!socketPath.isEmpty() && !server.listenLocal(socketPath))
+    {
+        err << server.lastError() << "\n";
+        return 1;
+    }
+
+    punchThread.start();
+    reportThread.start();
+
+    int result = QCoreApplication::exec();
+
+    punchThread.quit();
+    reportThread.quit();
+    punchThread.wait();
+    reportThread.wait();
+    delete metrics;
+    return result;
+}
+
+/**
+ * @brief SimulatedKiosk::SimulatedKiosk
+ * @param client connection to the daemon, already started on its own thread.
+ * @param punches swipes to make before emitting done().
+ * @param users swipe user ids 1 to users.
+ */
+SimulatedKiosk::SimulatedKiosk(JobRunner *client, int punches, int users, QObject *parent) :
+    QObject(parent),
+    failures(0),
+    client(client),
+    remaining(punches),
+    users(users)
+{
+    connect(client, SIGNAL(finished(DbResult)), this, SLOT(answered(DbResult)), Qt::QueuedConnection);
+}
+
+void SimulatedKiosk::next()
+{
+    if(remaining <= 0)
+    {
+        emit done();
+        return;
+    }
+
+    remaining--;
+
+    DbJob job;
+    job.type = DbJob::Toggle;
+    job.userId = 1 + qrand() % users;
+    job.serial = 0;
+    job.reader = 1;
+
+    timer.start();
+    client->submit(job);
+}
+
+void SimulatedKiosk::answered(DbResult result)
+{
+    nanos.push_back(timer.nsecsElapsed());
+    if(!result.success)
+        failures++;
+
+    next();
+}
+
+int runKioskSimulation(const QStringList &args)
+{
+    QTextStream out(stdout);
+
+    int kiosks = optionValue(args, "--simulate-kiosks").toInt();
+    QString address = optionValue(args, "--connect", DEFAULT_SOCKET);
+    int punches = optionValue(args, "--punches", "1000").toInt();
+    int users = optionValue(args, "--users", "100").toInt();
+    if(kiosks <= 0 || punches <= 0 || users <= 0)
+    {
+        out << "usage: Signin --simulate-kiosks N [--connect ADDRESS] [--punches M] [--users U]\n";
+        return 2;
+    }
+
+    QList<QThread *> threads;
+    QList<SimulatedKiosk *> simulated;
+    int running = kiosks;
+
+    QEventLoop loop;
+    for(int i = 0; i < kiosks; i++)
+    {
+        QThread *thread = new QThread();
+        PunchClient *client = new PunchClient(address);
+        client->moveToThread(thread);
+        QObject::connect(thread, SIGNAL(started()), client, SLOT(start()));
+        QObject::connect(thread, SIGNAL(finished()), client, SLOT(deleteLater()));
+        thread->start();
+        threads.append(thread);
+
+        SimulatedKiosk *kiosk = new SimulatedKiosk(client, punches, users);
+        QObject::connect(kiosk, SIGNAL(done()), &loop, SLOT(quit()));
+        simulated.append(kiosk);
+    }
+
+    QElapsedTimer wall;
+    wall.start();
+    for(int i = 0; i < simulated.size(); i++)
+    {
+        simulated[i]->next();
+    }
+
+    // Every done() wakes the loop once.
+    while(running > 0)
+    {
+        loop.exec();
+        running = kiosks;
+        for(int i = 0; i < simulated.size(); i++)
+        {
+            if((int)simulated[i]->nanos.size() >= punches)
+                running--;
+        }
+    }
+    qint64 wallNanos = wall.nsecsElapsed();
+
+    std::vector<qint64> all;
+    int failures = 0;
+    for(int i = 0; i < simulated.size(); i++)
+    {
+        all.insert(all.end(), simulated[i]->nanos.begin(), simulated[i]->nanos.end());
+        failures += simulated[i]->failures;
+        delete simulated[i];
+    }
+
+    for(int i = 0; i < threads.size(); i++)
+    {
+        threads[i]->quit();
+        threads[i]->wait();
+        delete threads[i];
+    }
+
+    std::sort(all.begin(), all.end());
+    int n = (int)all.size();
+    out << kiosks << " kiosks, " << n << " punches, " << failures << " failed\n"
+        << "p50 " << all[n * 50 / 100] / 1000.0 << " us, "
+        << "p99 " << all[qMin(n - 1, n * 99 / 100)] / 1000.0 << " us, "
+        << n * 1e9 / wallNanos << " punches/s\n";
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QStringList>
+#include <vector>
+#include "dbworker.h"
+
+/**
+ * @brief runDaemon run the punch daemon until killed: Signin --daemon [--listen PORT]
+ *        [--socket PATH] [--journal PATH].  Needs a QCoreApplication and a configured
+ *        DbConnection.
+ */
+int runDaemon(const QStringList &args);
+
+/**
+ * @brief runKioskSimulation drive a punch daemon with simulated kiosks and print the
+ *        latencies they saw: Signin --simulate-kiosks N --connect ADDRESS
+ *        [--punches M] [--users U].  Needs a QCoreApplication.
+ */
+int runKioskSimulation(const QStringList &args);
+
+/**
+ * @brief The SimulatedKiosk class plays one kiosk for runKioskSimulation(): it swipes
+ *        random users at a reader, one at a time, and times each answer.
+ */
+class SimulatedKiosk : public QObject
+{
+    Q_OBJECT
+
+public:
+    SimulatedKiosk(JobRunner *client, int punches, int users, QObject *parent = 0);
+
+    std::vector<qint64> nanos;
+    int failures;
+
+signals:
+    void done();
+
+public slots:
+    void next();
+
+private slots:
+    void answered(DbResult result);
+
+private:
+    JobRunner *client;
+    int remaining;
+    int users;
+    QElapsedTimer timer;
+};
+
+#endif // DAEMON_H
@@ -0,0 +1,256 @@
+#include "dbconnection.h"
+#include "metrics.h"
+#include "mysqlbackend.h"
+#include <QtSql/QtSql>
+#include <QThreadStorage>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDebug>
+
+// Check a connection with a round trip if it has been idle for longer than this.
+static const int HEALTH_CHECK_IDLE_MS = 30000;
+// Reconnect backoff starts here and doubles on every failed attempt, up to the max.
+static const int MIN_BACKOFF_MS = 250;
+static const int MAX_BACKOFF_MS = 30000;
+
+static QMutex backendLock;
+static StorageBackend *currentBackend = 0;
+
+static QAtomicInt connectionSerial(0);
+static QAtomicInt reconnects(0);
+
+/**
+ * @brief Per-thread bookkeeping for that thread's connection.
+ *        Removing the named connection when the thread exits keeps QSqlDatabase from
+ *        complaining about connections left open at shutdown.
+ */
+struct ConnectionState
+{
+    QString name;
+    QElapsedTimer lastUsed;
+    QElapsedTimer sinceFailure;
+    int backoff;
+    bool suspect;
+    bool everOpened;
+    int openFlag;       // 1 if timesheet_entry has IsOpen, 0 if not, -1 not checked yet.
+    QHash<QString, QSqlQuery> statements;
+
+    explicit ConnectionState(QString n) : name(n), backoff(0), suspect(false), everOpened(false), openFlag(-1) {}
+
+    ~ConnectionState()
+    {
+        statements.clear();
+        {
+            QSqlDatabase db = QSqlDatabase::database(name, false);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(name);
+    }
+};
+
+static QThreadStorage<ConnectionState*> threadState;
+
+/**
+ * @brief DbConnection::configure use the MySQL server with these credentials for every
+ *        thread's connection.  Must be called before the first call to database().
+ * @param host mysql server host name.
+ * @param uname username/database for the timeclock.
+ * @param pwd password for the user.
+ */
+void DbConnection::configure(QString host, QString uname, QString pwd)
+{
+    setBackend(new MySqlBackend(host, uname, pwd));
+}
+
+/**
+ * @brief DbConnection::setBackend use another database engine, e.g. an SqliteBackend.
+ *        Takes ownership.  Must be called before the first call to database().
+ */
+void DbConnection::setBackend(StorageBackend *backend)
+{
+    QMutexLocker lock(&backendLock);
+    delete currentBackend;
+    currentBackend = backend;
+}
+
+/**
+ * @brief DbConnection::backend the engine connections are opened with; MySQL with no
+ *        credentials until one is configured.
+ */
+StorageBackend *DbConnection::backend()
+{
+    QMutexLocker lock(&backendLock);
+    if(!currentBackend)
+        currentBackend = new MySqlBackend(QString(), QString(), QString());
+
+    return currentBackend;
+}
+
+/**
+ * @brief DbConnection::database get the calling thread's connection, opening it if needed.
+ *        Callers should check isOpen() on the result; while the server is unreachable the
+ *        returned connection stays closed until the backoff period has passed.
+ * @return the connection owned by the calling thread.
+ */
+QSqlDatabase DbConnection::database()
+{
+    if(!threadState.hasLocalData())
+    {
+        ConnectionState *state = new ConnectionState(QString("signin_%1").arg(connectionSerial.fetchAndAddRelaxed(1)));
+        backend()->addDatabase(state->name);
+        threadState.setLocalData(state);
+    }
+
+    ConnectionState *state = threadState.localData();
+    QSqlDatabase db = QSqlDatabase::database(state->name, false);
+
+    if(db.isOpen())
+    {
+        // Recently used and nothing has gone wrong since: trust it without a round trip.
+        if(!state->suspect && state->lastUsed.isValid() && state->lastUsed.elapsed() < HEALTH_CHECK_IDLE_MS)
+        {
+            state->lastUsed.restart();
+            return db;
+        }
+
+        if(isHealthy(db))
+        {
+            state->suspect = false;
+            state->lastUsed.restart();
+            return db;
+        }
+
+        qWarning() << "Database connection" << state->name << "dropped:" << db.lastError().text();
+        state->statements.clear();
+        db.close();
+    }
+
+    // Still inside the backoff window from the last failed attempt.
+    if(state->sinceFailure.isValid() && state->sinceFailure.elapsed() < state->backoff)
+    {
+        return db;
+    }
+
+    state->statements.clear();
+    state->openFlag = -1;
+    QElapsedTimer connectTimer;
+    connectTimer.start();
+    bool opened = db.open();
+    if(opened && !backend()->prepare(db))
+    {
+        db.close();
+        opened = false;
+    }
+    Metrics::record(Metrics::DbConnect, connectTimer.nsecsElapsed());
+
+    if(opened)
+    {
+        if(state->everOpened)
+        {
+            Metrics::count(Metrics::Reconnects);
+            int count = reconnects.fetchAndAddRelaxed(1) + 1;
+            qWarning() << "Database connection" << state->name << "re-established, reconnect count:" << count;
+        }
+
+        state->everOpened = true;
+        state->suspect = false;
+        state->backoff = 0;
+        state->sinceFailure.invalidate();
+        state->lastUsed.restart();
+    }
+    else
+    {
+        Metrics::count(Metrics::ConnectFailures);
+        state->backoff = state->backoff == 0 ? MIN_BACKOFF_MS : qMin(state->backoff * 2, MAX_BACKOFF_MS);
+        state->sinceFailure.restart();
+        qWarning() << "Could not connect to database, retrying in" << state->backoff << "ms:" << db.lastError().text();
+    }
+
+    return db;
+}
+
+/**
+ * @brief DbConnection::hasOpenFlag whether timesheet_entry has the IsOpen column that
+ *        --migrate adds, so the open entry queries can use its index.  Asked once per
+ *        connection.
+ * @param db connection returned by database() on the calling thread.
+ */
+bool DbConnection::hasOpenFlag(const QSqlDatabase &db)
+{
+    ConnectionState *state = threadState.hasLocalData() ? threadState.localData() : 0;
+    if(state && state->name == db.connectionName() && state->openFlag >= 0)
+        return state->openFlag == 1;
+
+    bool found = backend()->hasColumn(db, "timesheet_entry", "IsOpen");
+    if(state && state->name == db.connectionName())
+        state->openFlag = found ? 1 : 0;
+
+    return found;
+}
+
+/**
+ * @brief DbConnection::prepared get a statement prepared on this thread's connection.
+ *        The statement is prepared the first time it is asked for and cached until the
+ *        connection drops.  The returned query shares its result with the cached one, so
+ *        bind values with bindValue(index, ...) before every exec and call finish() once
+ *        the rows have been read.
+ * @param db connection returned by database() on the calling thread.
+ * @param sql statement text with ? placeholders.
+ * @return the prepared query.
+ */
+QSqlQuery DbConnection::prepared(const QSqlDatabase &db, const QString &sql)
+{
+    if(!threadState.hasLocalData() || threadState.localData()->name != db.connectionName())
+    {
+        QSqlQuery q(db);
+        q.prepare(sql);
+        return q;
+    }
+
+    ConnectionState *state = threadState.localData();
+    QHash<QString, QSqlQuery>::const_iterator it = state->statements.constFind(sql);
+    if(it != state->statements.constEnd())
+    {
+        return it.value();
+    }
+
+    QSqlQuery q(db);
+    if(q.prepare(sql))
+    {
+        state->statements.insert(sql, q);
+    }
+
+    return q;
+}
+
+/**
+ * @brief DbConnection::reportError tell the manager a query on this thread's connection failed.
+ *        The next call to database() will health-check the link before handing it out.
+ * @param db the connection the failed query ran on.
+ */
+void DbConnection::reportError(const QSqlDatabase &db)
+{
+    Metrics::count(Metrics::QueryErrors);
+
+    if(!threadState.hasLocalData() || threadState.localData()->name != db.connectionName())
+        return;
+
+    threadState.localData()->suspect = true;
+}
+
+/**
+ * @brief DbConnection::reconnectCount
+ * @return number of times any thread has had to re-establish a dropped connection.
+ */
+int DbConnection::reconnectCount()
+{
+    return reconnects.fetchAndAddRelaxed(0);
+}
+
+bool DbConnection::isHealthy(QSqlDatabase &db)
+{
+    QSqlQuery ping(db);
+    return ping.exec("SELECT 1");
+}
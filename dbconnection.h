@@ -0,0 +1,43 @@
+#ifndef DBCONNECTION_H
+#define DBCONNECTION_H
+
+#include <QString>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include "storagebackend.h"
+
+/**
+ * @brief The DbConnection class hands out one long-lived database connection per thread.
+ *        QSqlDatabase connections may only be used from the thread that created them, so
+ *        each thread gets its own named connection the first time it asks for one.  The
+ *        connection is kept open between punches and is only health-checked after it has
+ *        been idle for a while or after a query reported a connection error.  If the link
+ *        drops, reconnect attempts back off exponentially so a dead server does not stall
+ *        every button press with a fresh connect timeout.
+ *
+ *        Hot queries are prepared once per connection through prepared() and reused with
+ *        bound parameters, so MySQL does not re-parse them on every swipe.
+ *
+ *        Connections are opened through the configured StorageBackend: the MySQL server
+ *        by default, or a local SQLite file.
+ *
+ *        hasOpenFlag() tells whether --migrate has added the indexed IsOpen column; it
+ *        is checked once per connection.
+ */
+class DbConnection
+{
+public:
+    static void configure(QString host, QString uname, QString pwd);
+    static void setBackend(StorageBackend *backend);
+    static StorageBackend *backend();
+    static QSqlDatabase database();
+    static QSqlQuery prepared(const QSqlDatabase &db, const QString &sql);
+    static void reportError(const QSqlDatabase &db);
+    static bool hasOpenFlag(const QSqlDatabase &db);
+    static int reconnectCount();
+
+private:
+    static bool isHealthy(QSqlDatabase &db);
+};
+
+#endif // DBCONNECTION_H
@@ -0,0 +1,424 @@
+#include "dbworker.h"
+#include <QMutexLocker>
+#include <QMetaObject>
+#include <QTimer>
+#include "roster.h"
+#include "usertotals.h"
+#include "columnstore.h"
+#include "snapshot.h"
+#include "metrics.h"
+
+// How often the roster is checked for new or changed users and the open
+// session index is reconciled with the database.
+static const int CACHE_REFRESH_MS = 60000;
+// Journaled punches are written in transactions of at most this many.
+static const int REPLAY_BATCH = 100;
+// How long to collect punches before writing them as one transaction.
+static const int DEFAULT_COMMIT_WINDOW_MS = 250;
+// How soon to try writing journaled punches again after the database refused them.
+static const int REPLAY_RETRY_MS = 5000;
+
+DbWorker::DbWorker(Roster *roster, OpenSessions *sessions, PunchJournal *journal, UserTotals *totals, ColumnStore *columns, Rollups *rollups, QObject *parent) :
+    JobRunner(parent),
+    scheduled(false),
+    roster(roster),
+    sessions(sessions),
+    totals(totals),
+    columns(columns),
+    rollups(rollups),
+    snapshot(0),
+    timesheet(roster, sessions, journal, totals, columns, rollups),
+    refreshTimer(0),
+    replayTimer(0),
+    commitTimer(0)
+{
+    qRegisterMetaType<DbResult>("DbResult");
+}
+
+/**
+ * @brief DbWorker::start runs on the worker thread: load the caches and schedule refreshes.
+ */
+void DbWorker::start()
+{
+    refreshTimer = new QTimer(this);
+    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(refreshCaches()));
+    refreshTimer->start(CACHE_REFRESH_MS);
+
+    replayTimer = new QTimer(this);
+    replayTimer->setSingleShot(true);
+    connect(replayTimer, SIGNAL(timeout()), this, SLOT(replayJournal()));
+
+    bool ok = false;
+    int window = qgetenv("SIGNIN_COMMIT_WINDOW_MS").toInt(&ok);
+    commitTimer = new QTimer(this);
+    commitTimer->setSingleShot(true);
+    commitTimer->setInterval(ok && window >= 0 ? window : DEFAULT_COMMIT_WINDOW_MS);
+    connect(commitTimer, SIGNAL(timeout()), this, SLOT(replayJournal()));
+
+    refreshCaches();
+}
+
+/**
+ * @brief DbWorker::refreshCaches pick up users added or changed since the last refresh
+ *        and reconcile the open session index.  Runs between jobs, never during one.
+ */
+void DbWorker::refreshCaches()
+{
+    if(roster)
+        roster->refresh();
+
+    // Write out journaled punches first so the reconcile sees them.
+    replayJournal();
+    timesheet.reconcileOpenSessions();
+
+    // Loaded once; after that they are kept up by the punches.
+    if(totals && !totals->isLoaded())
+        timesheet.rebuildTotals();
+    if(rollups && !rollups->isLoaded())
+        timesheet.rebuildRollups();
+
+    if(columns)
+        columns->refresh();
+
+    if(snapshot && roster && sessions)
+        snapshot->save(roster, sessions);
+}
+
+/**
+ * @brief DbWorker::setSnapshot keep the roster and open sessions saved in snapshot.
+ *        Call before start().
+ */
+void DbWorker::setSnapshot(Snapshot *snapshot)
+{
+    this->snapshot = snapshot;
+}
+
+/**
+ * @brief DbWorker::setSharedJournal see Timesheet::setSharedJournal.  Call before the
+ *        first job.
+ */
+void DbWorker::setSharedJournal(PunchJournal *journal)
+{
+    timesheet.setSharedJournal(journal);
+}
+
+/**
+ * @brief DbWorker::replayJournal write journaled punches to the database.
+ *        If the database is unreachable, try again in REPLAY_RETRY_MS.
+ */
+void DbWorker::replayJournal()
+{
+    if(timesheet.replayJournal(REPLAY_BATCH) != Timesheet::Ok)
+    {
+        if(!replayTimer->isActive())
+            replayTimer->start(REPLAY_RETRY_MS);
+        return;
+    }
+
+    if(snapshot && roster && sessions)
+        snapshot->save(roster, sessions);
+}
+
+/**
+ * @brief DbWorker::submit queue a job.  Safe to call from any thread.
+ *        Jobs run one at a time, in the order they were submitted.
+ * @param job the job to run.
+ */
+void DbWorker::submit(const DbJob &job)
+{
+    QMutexLocker locker(&lock);
+    queue.enqueue(job);
+
+    if(!scheduled)
+    {
+        scheduled = true;
+        QMetaObject::invokeMethod(this, "processQueue", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief DbWorker::processQueue runs on the worker thread and drains the job queue.
+ */
+void DbWorker::processQueue()
+{
+    forever
+    {
+        DbJob job;
+        {
+            QMutexLocker locker(&lock);
+            if(queue.isEmpty())
+            {
+                scheduled = false;
+                return;
+            }
+            job = queue.dequeue();
+        }
+
+        emit finished(run(job));
+
+        // The punch is acknowledged; write it out with whatever else arrives in the
+        // commit window.
+        if((job.type == DbJob::SignIn || job.type == DbJob::SignOut || job.type == DbJob::Toggle)
+                && commitTimer && !commitTimer->isActive())
+            commitTimer->start();
+    }
+}
+
+QString DbWorker::errorMessage(Timesheet::Result r)
+{
+    if(r == Timesheet::NoConnection)
+        return "Could Not Connect to Database...";
+
+    return "Database error, please try again.";
+}
+
+/**
+ * @brief DbWorker::run execute one job and format its output for the display.
+ *        Runs on the calling thread: processQueue() uses it for submitted jobs, and the
+ *        benchmark calls it directly.
+ */
+DbResult DbWorker::run(const DbJob &job)
+{
+    MetricsTimer timer((Metrics::Stage)(Metrics::JobLookupUser + job.type));
+
+    DbResult result;
+    result.job = job;
+    result.success = false;
+
+    Timesheet::Result r = Timesheet::QueryFailed;
+
+    switch(job.type)
+    {
+    case DbJob::LookupUser:
+    {
+        UserInfo user;
+        r = timesheet.findUser(job.userId, user);
+        if(r == Timesheet::Ok)
+        {
+            result.success = true;
+            result.name = user.firstName + " " + user.lastName;
+            result.lines << "Hello, " + result.name;
+        }
+        else if(r == Timesheet::NotFound)
+        {
+            result.lines << QString("Invalid Id: ") + QString::number(job.userId);
+            result.lines << "Type 1111 to see the list of ID numbers.";
+        }
+        break;
+    }
+    case DbJob::SignIn:
+        r = timesheet.signIn(job.userId);
+        if(r == Timesheet::Ok)
+        {
+            result.success = true;
+            result.lines << "Successfully Signed in at:";
+            result.lines << QDateTime().currentDateTime().toString();
+        }
+        else if(r == Timesheet::AlreadySignedIn)
+        {
+            result.lines << "You are already signed in!";
+        }
+        break;
+    case DbJob::SignOut:
+        r = timesheet.signOut(job.userId);
+        if(r == Timesheet::Ok)
+        {
+            result.success = true;
+            result.lines << "Sucessfully Signed Out.";
+        }
+        else if(r == Timesheet::NotSignedIn)
+        {
+            result.lines << "You are not currently signed in.";
+        }
+        break;
+    case DbJob::Status:
+    {
+        OpenEntry entry;
+        r = timesheet.findOpenEntry(job.userId, entry);
+        if(r == Timesheet::Ok)
+        {
+            result.success = true;
+            int seconds = entry.timeIn.secsTo(QDateTime::currentDateTime());
+            int hours = seconds / 3600;
+            seconds -= hours * 3600;
+            int minutes = seconds / 60;
+
+            result.lines << QString("You have been signed in for %1 hours, %2 minutes.").arg(hours).arg(minutes);
+        }
+        else if(r == Timesheet::NotSignedIn)
+        {
+            result.lines << "You are currently signed out.";
+        }
+        break;
+    }
+    case DbJob::History:
+    {
+        UserStats stats;
+        r = timesheet.history(job.userId, stats);
+        if(r == Timesheet::Ok)
+        {
+            result.success = true;
+            result.lines << "You have been signed on for:";
+            result.lines << toString(stats.timeOn);
+            result.lines << QString("You have forgotten to sign out %1 times...").arg(stats.notSignedOutCount);
+
+            QDate today = QDate::currentDate();
+            qint64 week = 0;
+            qint64 month = 0;
+            if(timesheet.rangeSeconds(job.userId, Rollups::periodStart(Rollups::Week, today), today, week) == Timesheet::Ok
+                    && timesheet.rangeSeconds(job.userId, Rollups::periodStart(Rollups::Month, today), today, month) == Timesheet::Ok)
+            {
+                result.lines << QString("This week: %1 hours.  This month: %2 hours.")
+                                .arg(week / 3600.0, 0, 'f', 1).arg(month / 3600.0, 0, 'f', 1);
+            }
+        }
+        break;
+    }
+    case DbJob::ListUsers:
+    {
+        QList<UserInfo> users;
+        r = timesheet.listUsers(users);
+        result.success = r == Timesheet::Ok;
+        for(int i = 0; i < users.size(); i++)
+        {
+            result.lines << QString("%1 -- %2 %3").arg(users[i].id).arg(users[i].firstName).arg(users[i].lastName);
+        }
+        break;
+    }
+    case DbJob::CurrentSignIns:
+    {
+        QList<OpenEntry> entries;
+        r = timesheet.listOpenEntries(entries);
+        result.success = r == Timesheet::Ok;
+        QDateTime now = QDateTime::currentDateTime();
+        for(int i = 0; i < entries.size(); i++)
+        {
+            timespan ts;
+            ts.days=0;
+            ts.hours=0;
+            ts.minutes=0;
+            ts.seconds=0;
+            addSeconds(ts, entries[i].timeIn.secsTo(now));
+            result.lines << QString("%1 %2 -- %3").arg(entries[i].user.firstName).arg(entries[i].user.lastName).arg(toString(ts));
+        }
+        break;
+    }
+    case DbJob::AllStats:
+    {
+        QList<UserStats> stats;
+        r = timesheet.allStats(stats);
+        result.success = r == Timesheet::Ok;
+        for(int i = 0; i < stats.size(); i++)
+        {
+            result.lines << stats[i].user.firstName + " " + stats[i].user.lastName;
+            result.lines << QString("%1 (%2)").arg(toString(stats[i].timeOn)).arg(stats[i].notSignedOutCount);
+            result.lines << "__________________________";
+        }
+        break;
+    }
+    case DbJob::PeriodHours:
+    {
+        QList<UserInfo> users;
+        r = timesheet.listUsers(users);
+        if(r != Timesheet::Ok)
+            break;
+
+        if(!timesheet.rollupsLoaded())
+        {
+            result.lines << "The weekly hours have not been loaded yet.";
+            break;
+        }
+
+        QDate today = QDate::currentDate();
+        QDate thisWeek = Rollups::periodStart(Rollups::Week, today);
+        QDate thisMonth = Rollups::periodStart(Rollups::Month, today);
+        result.success = true;
+        for(int i = 0; i < users.size() && r == Timesheet::Ok; i++)
+        {
+            qint64 week = 0;
+            qint64 lastWeek = 0;
+            qint64 month = 0;
+            r = timesheet.rangeSeconds(users[i].id, thisWeek, today, week);
+            if(r == Timesheet::Ok)
+                r = timesheet.rangeSeconds(users[i].id, thisWeek.addDays(-7), thisWeek.addDays(-1), lastWeek);
+            if(r == Timesheet::Ok)
+                r = timesheet.rangeSeconds(users[i].id, thisMonth, today, month);
+
+            result.lines << users[i].firstName + " " + users[i].lastName;
+            result.lines << QString("Week %1 h, last week %2 h, month %3 h")
+                            .arg(week / 3600.0, 0, 'f', 1).arg(lastWeek / 3600.0, 0, 'f', 1).arg(month / 3600.0, 0, 'f', 1);
+        }
+        break;
+    }
+    case DbJob::Toggle:
+    {
+        QString prefix = QString("Reader %1: ").arg(job.reader + 1);
+        UserInfo user;
+        bool signedIn = false;
+        r = timesheet.findUser(job.userId, user);
+        if(r == Timesheet::Ok)
+            r = timesheet.toggle(job.userId, signedIn);
+
+        if(r == Timesheet::Ok)
+        {
+            result.success = true;
+            result.lines << prefix + user.firstName + " " + user.lastName
+                            + (signedIn ? " signed in at " : " signed out at ")
+                            + QTime::currentTime().toString("hh:mm ap");
+        }
+        else if(r == Timesheet::NotFound)
+        {
+            result.lines << prefix + QString("Invalid Id: ") + QString::number(job.userId);
+        }
+        break;
+    }
+    case DbJob::VerifyTotals:
+    {
+        // The recount only matches once every journaled punch is in the database.
+        timesheet.replayJournal(REPLAY_BATCH);
+
+        QList<UserTotal> kept;
+        QList<UserTotal> actual;
+        r = timesheet.verifyTotals(kept, actual);
+        if(r == Timesheet::NotFound)
+        {
+            result.lines << "The totals have not been loaded yet.";
+        }
+        else if(r == Timesheet::Ok)
+        {
+            for(int i = 0; i < kept.size(); i++)
+            {
+                result.lines << QString("User %1: kept %2 s, %3 done, %4 open; database %5 s, %6 done, %7 open")
+                                .arg(kept[i].userId).arg(kept[i].seconds).arg(kept[i].completed).arg(kept[i].unclosed)
+                                .arg(actual[i].seconds).arg(actual[i].completed).arg(actual[i].unclosed);
+            }
+
+            result.lines << (kept.isEmpty() ? "All totals match." : QString("%1 users did not match.").arg(kept.size()));
+        }
+
+        if(r == Timesheet::Ok || r == Timesheet::NotFound)
+        {
+            r = timesheet.rebuildTotals();
+            result.success = r == Timesheet::Ok;
+            if(result.success)
+                result.lines << "Totals rebuilt.";
+
+            if(result.success && rollups && timesheet.rebuildRollups() == Timesheet::Ok)
+                result.lines << "Weekly and monthly hours rebuilt.";
+
+            // Also the one way hand edits to old entries reach the column copy.
+            if(result.success && columns && columns->reload())
+                result.lines << "Column copy reloaded.";
+        }
+        break;
+    }
+    }
+
+    if(r == Timesheet::NoConnection || r == Timesheet::QueryFailed)
+    {
+        result.success = false;
+        result.lines << errorMessage(r);
+    }
+
+    return result;
+}
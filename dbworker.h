@@ -0,0 +1,148 @@
+#ifndef DBWORKER_H
+#define DBWORKER_H
+
+#include <QObject>
+#include <QMetaType>
+#include <QMutex>
+#include <QQueue>
+#include <QStringList>
+#include "timesheet.h"
+
+class QTimer;
+class Roster;
+class OpenSessions;
+class PunchJournal;
+class UserTotals;
+class ColumnStore;
+class Rollups;
+class Snapshot;
+
+/**
+ * @brief A request for the DbWorker.
+ */
+struct DbJob
+{
+    enum Type
+    {
+        LookupUser,
+        SignIn,
+        SignOut,
+        Status,
+        History,
+        ListUsers,
+        CurrentSignIns,
+        AllStats,
+        VerifyTotals,
+        Toggle,         // sign in, or out if signed in: a swipe at another reader.
+        PeriodHours     // everyone's hours this week, last week and this month.
+    };
+
+    Type type;
+    int userId;
+    int serial;     // MainWindow session the job was submitted from.
+    int reader;     // ReaderPool index for Toggle; 0 otherwise.
+};
+
+/**
+ * @brief The outcome of a DbJob, ready to be shown in the output display.
+ */
+struct DbResult
+{
+    DbResult() : success(false), waited(false) {}
+
+    DbJob job;
+    bool success;   // the operation happened (user found, signed in, ...)
+    bool waited;    // waiting() was sent for the job first.
+    QString name;   // LookupUser only.
+    QStringList lines;
+};
+
+Q_DECLARE_METATYPE(DbResult)
+
+/**
+ * @brief The JobRunner class is what the window hands DbJobs to: the local DbWorker, or a
+ *        PunchClient that forwards them to a punch daemon.  submit() may be called from
+ *        any thread; the results come back through finished().  A job that is held up
+ *        but will still be carried out may be reported through waiting() first, which
+ *        the window takes as the job being accepted; its finished() follows later,
+ *        with waited set.
+ */
+class JobRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JobRunner(QObject *parent = 0) : QObject(parent) {}
+    virtual void submit(const DbJob &job) = 0;
+
+public slots:
+    virtual void start() = 0;
+
+signals:
+    void finished(DbResult result);
+    void waiting(DbResult result);
+};
+
+/**
+ * @brief The DbWorker class runs database jobs off the GUI thread.
+ *        Move it to its own QThread; submit() may be called from any thread and the
+ *        results come back through the finished() signal, which should be connected
+ *        with a queued connection.
+ *
+ *        Once its thread is running, call start() (queued) to load the roster, the open
+ *        session index, the user totals, the rollups and the column copy if there is one,
+ *        and to keep the roster, the index and the column copy fresh every
+ *        CACHE_REFRESH_MS.  The totals and rollups are kept up by the punches, and only
+ *        rebuilt by the VerifyTotals job.
+ *
+ *        Punches are journaled by the SignIn/SignOut jobs and group committed: the first
+ *        punch opens a short commit window (SIGNIN_COMMIT_WINDOW_MS in the environment,
+ *        DEFAULT_COMMIT_WINDOW_MS otherwise), and every punch journaled before it closes
+ *        is written in the same transaction.  While the database is unreachable the
+ *        write is retried every REPLAY_RETRY_MS.
+ *
+ *        With a Snapshot set, the roster and open sessions are saved to it after every
+ *        refresh and every write of punches.
+ *
+ *        A worker that is never started keeps no caches fresh and writes nothing on its
+ *        own; the punch daemon uses one like that, without a journal, for the reports,
+ *        with the punch worker's journal set through setSharedJournal().
+ */
+class DbWorker : public JobRunner
+{
+    Q_OBJECT
+
+public:
+    DbWorker(Roster *roster, OpenSessions *sessions, PunchJournal *journal, UserTotals *totals, ColumnStore *columns = 0, Rollups *rollups = 0, QObject *parent = 0);
+    void submit(const DbJob &job);
+    DbResult run(const DbJob &job);
+    void setSnapshot(Snapshot *snapshot);
+    void setSharedJournal(PunchJournal *journal);
+
+public slots:
+    void start();
+
+private slots:
+    void processQueue();
+    void refreshCaches();
+    void replayJournal();
+
+private:
+    QString errorMessage(Timesheet::Result r);
+
+    QMutex lock;
+    QQueue<DbJob> queue;
+    bool scheduled;
+    Roster *roster;
+    OpenSessions *sessions;
+    UserTotals *totals;
+    ColumnStore *columns;
+    Rollups *rollups;
+    Snapshot *snapshot;
+    Timesheet timesheet;
+    QTimer *refreshTimer;
+    QTimer *replayTimer;
+    QTimer *commitTimer;
+};
+
+#endif // DBWORKER_H
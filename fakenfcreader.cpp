@@ -0,0 +1,146 @@
+#include "fakenfcreader.h"
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QMutexLocker>
+#include <thread>
+
+FakeNfcReader::FakeNfcReader() :
+    lastDue(0),
+    opened(false)
+{
+    clock.start();
+}
+
+/**
+ * @brief FakeNfcReader::addSwipe queue a card to be presented.
+ * @param delayMs time after the previous swipe.
+ * @param uid card to present.
+ */
+void FakeNfcReader::addSwipe(int delayMs, const NfcUid &uid)
+{
+    QMutexLocker locker(&lock);
+    Swipe s;
+    lastDue += delayMs;
+    s.due = lastDue;
+    s.uid = uid;
+    swipes.enqueue(s);
+}
+
+/**
+ * @brief FakeNfcReader::loadScript queue every swipe in a script file.
+ * @return false if the file could not be read or has a malformed line.
+ */
+bool FakeNfcReader::loadScript(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        error = "Could not open " + path;
+        return false;
+    }
+
+    QTextStream in(&file);
+    int lineNo = 0;
+    while(!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        lineNo++;
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList parts = line.split(' ', QString::SkipEmptyParts);
+        bool ok = false;
+        int delay = parts.size() == 2 ? parts[0].toInt(&ok) : 0;
+        NfcUid uid = ok ? NfcUid::fromHex(parts[1]) : NfcUid();
+        if(!uid.isValid())
+        {
+            error = QString("%1:%2: expected \"<delay ms> <uid hex>\"").arg(path).arg(lineNo);
+            return false;
+        }
+
+        addSwipe(delay, uid);
+    }
+
+    return true;
+}
+
+/**
+ * @brief FakeNfcReader::failNextOpen make the next open() fail, to exercise reconnects.
+ */
+void FakeNfcReader::failNextOpen(const QString &message)
+{
+    QMutexLocker locker(&lock);
+    openFailure = message;
+}
+
+/**
+ * @brief FakeNfcReader::remaining
+ * @return number of swipes not yet presented.
+ */
+int FakeNfcReader::remaining()
+{
+    QMutexLocker locker(&lock);
+    return swipes.size();
+}
+
+bool FakeNfcReader::open()
+{
+    QMutexLocker locker(&lock);
+    if(!openFailure.isEmpty())
+    {
+        error = openFailure;
+        openFailure.clear();
+        opened = false;
+        return false;
+    }
+
+    opened = true;
+    error.clear();
+    return true;
+}
+
+void FakeNfcReader::close()
+{
+    QMutexLocker locker(&lock);
+    opened = false;
+}
+
+bool FakeNfcReader::isOpen() const
+{
+    return opened;
+}
+
+bool FakeNfcReader::poll(NfcUid &uid, int timeoutMs)
+{
+    qint64 wait = timeoutMs;
+    bool found = false;
+    {
+        QMutexLocker locker(&lock);
+        if(!opened)
+            return false;
+
+        if(!swipes.isEmpty())
+        {
+            qint64 untilDue = swipes.head().due - clock.elapsed();
+            if(untilDue <= timeoutMs)
+            {
+                wait = qMax(untilDue, (qint64)0);
+                found = true;
+            }
+        }
+    }
+
+    if(wait > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+
+    if(!found)
+        return false;
+
+    QMutexLocker locker(&lock);
+    if(swipes.isEmpty())
+        return false;
+
+    uid = swipes.dequeue().uid;
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef FAKENFCREADER_H
+#define FAKENFCREADER_H
+
+#include "nfcreader.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QQueue>
+
+/**
+ * @brief The FakeNfcReader class plays back a script of card swipes instead of talking
+ *        to hardware, for running the kiosk on a desktop and for tests.
+ *
+ *        Each swipe is due a delay after the previous one; the first is due a delay after
+ *        the reader was created.  A swipe that is already overdue is returned by the next
+ *        poll.  Swipes can be added from another thread while the reader is in use.
+ *        A script file has one swipe per line: "<delay ms> <uid hex>"; blank lines and
+ *        lines starting with # are skipped.
+ */
+class FakeNfcReader : public NfcReader
+{
+public:
+    FakeNfcReader();
+
+    void addSwipe(int delayMs, const NfcUid &uid);
+    bool loadScript(const QString &path);
+    void failNextOpen(const QString &message);
+    int remaining();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+    bool poll(NfcUid &uid, int timeoutMs);
+
+private:
+    struct Swipe
+    {
+        qint64 due;
+        NfcUid uid;
+    };
+
+    QMutex lock;
+    QQueue<Swipe> swipes;
+    qint64 lastDue;
+    QElapsedTimer clock;
+    bool opened;
+    QString openFailure;
+};
+
+#endif // FAKENFCREADER_H
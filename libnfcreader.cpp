@@ -0,0 +1,108 @@
+#include "libnfcreader.h"
+#include <nfc/nfc.h>
+
+// libnfc polls in periods of 150 ms.
+static const int POLL_PERIOD_MS = 150;
+
+/**
+ * @brief LibNfcReader::LibNfcReader
+ * @param connstring libnfc connection string, e.g. "pn532_uart:/dev/ttyUSB0".
+ *        Empty picks the first device libnfc finds, like nfc-poll did.
+ */
+LibNfcReader::LibNfcReader(QString connstring) :
+    connstring(connstring),
+    context(NULL),
+    device(NULL)
+{
+}
+
+LibNfcReader::~LibNfcReader()
+{
+    close();
+}
+
+bool LibNfcReader::open()
+{
+    close();
+
+    nfc_init(&context);
+    if(context == NULL)
+    {
+        error = "Unable to init libnfc.";
+        return false;
+    }
+
+    QByteArray cs = connstring.toLocal8Bit();
+    device = nfc_open(context, cs.isEmpty() ? NULL : cs.constData());
+    if(device == NULL)
+    {
+        error = "Unable to open NFC device.";
+        close();
+        return false;
+    }
+
+    if(nfc_initiator_init(device) < 0)
+    {
+        error = QString("Unable to start NFC initiator: %1").arg(nfc_strerror(device));
+        close();
+        return false;
+    }
+
+    error.clear();
+    return true;
+}
+
+void LibNfcReader::close()
+{
+    if(device != NULL)
+    {
+        nfc_close(device);
+        device = NULL;
+    }
+
+    if(context != NULL)
+    {
+        nfc_exit(context);
+        context = NULL;
+    }
+}
+
+bool LibNfcReader::isOpen() const
+{
+    return device != NULL;
+}
+
+bool LibNfcReader::poll(NfcUid &uid, int timeoutMs)
+{
+    if(device == NULL)
+        return false;
+
+    const nfc_modulation modulations[] = {
+        { NMT_ISO14443A, NBR_106 }
+    };
+
+    int polls = timeoutMs / POLL_PERIOD_MS;
+    if(polls < 1)
+        polls = 1;
+    if(polls > 0xFE)
+        polls = 0xFE;
+
+    nfc_target target;
+    int res = nfc_initiator_poll_target(device, modulations, 1, (uint8_t)polls, 1, &target);
+
+    if(res == 0 || res == NFC_ETIMEOUT)
+    {
+        // No target found.
+        return false;
+    }
+
+    if(res < 0)
+    {
+        error = QString("NFC poll failed: %1").arg(nfc_strerror(device));
+        close();
+        return false;
+    }
+
+    uid.bytes = QByteArray((const char *)target.nti.nai.abtUid, (int)target.nti.nai.szUidLen);
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef LIBNFCREADER_H
+#define LIBNFCREADER_H
+
+#include "nfcreader.h"
+
+struct nfc_context;
+struct nfc_device;
+
+/**
+ * @brief The LibNfcReader class talks to the Adafruit PN532 through libnfc in process.
+ *        The device is opened once and polled for ISO14443A cards, instead of starting
+ *        nfc-poll (and re-initializing the reader) for every swipe.
+ */
+class LibNfcReader : public NfcReader
+{
+public:
+    explicit LibNfcReader(QString connstring = QString());
+    ~LibNfcReader();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+    bool poll(NfcUid &uid, int timeoutMs);
+
+private:
+    QString connstring;
+    nfc_context *context;
+    nfc_device *device;
+};
+
+#endif // LIBNFCREADER_H
@@ -1,10 +1,24 @@
 #include "mainwindow.h"
+#include "dbconnection.h"
+#include "timesheet.h"
+#include "roster.h"
+#include "opensessions.h"
+#include "punchjournal.h"
+#include "usertotals.h"
+#include "metrics.h"
+#include "libnfcreader.h"
+#include "fakenfcreader.h"
+#include "readerpool.h"
+#include "punchclient.h"
+#include "columnstore.h"
+#include "rollups.h"
+#include "snapshot.h"
+#include "daemon.h"
+#include "migration.h"
+#include "swipereplay.h"
+#include "sqlitebackend.h"
+#include "stallwatchdog.h"
 #include <QApplication>
-#include <thread>
-#include <string>
-#include <iostream>
-#include <cstdio>
-#include <memory>
 #include <QtSql/QtSql>
 #include <QtSql/QMYSQLDriver>
 #include <QtSql/QSqlDatabase>
@@ -14,99 +28,176 @@ QString HOST;
 QString UNAME;
 QString PWD;
 
+// How often the metrics file is rewritten for the monitoring scraper.
+static const int METRICS_INTERVAL_MS = 10000;
+// How late the event loop may run before it is logged as a stall.
+static const int DEFAULT_STALL_MS = 200;
+
 /**
- * Execute a shell command and get the command's output in a String.
+ * @brief readAuth read the database connection config file and configure DbConnection.
+ * @return false if the file could not be opened and no local database is set.
  */
-std::string exec(const char* cmd)
+static bool readAuth()
 {
-    std::shared_ptr<FILE> pipe(popen(cmd, "r"), pclose);
-    if(!pipe) return "ERROR";
+    bool auth = false;
+
+    // Read the database connection config file.
+	// Config file should be of the form:
+	// |hostname or ip
+	// |database user name
+	// |database user password
+	//
+	// The configuration file is loaded from this address.
+    QFile file("/home/pi/.mysql_auth");
+    if(file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QTextStream in(&file);
+        HOST=in.readLine();
+        UNAME = in.readLine();
+        PWD = in.readLine();
 
-    char buffer[128];
-    std::string result = "";
+        file.close();
+        auth = true;
+    }
 
-    while(!feof(pipe.get()))
+    DbConnection::configure(HOST, UNAME, PWD);
+
+    // SIGNIN_SQLITE names a database file on this machine to use instead of the server.
+    QString sqlitePath = QString::fromLocal8Bit(qgetenv("SIGNIN_SQLITE"));
+    if(!sqlitePath.isEmpty())
     {
-        if(fgets(buffer, 128, pipe.get()) != NULL)
-            result += buffer;
+        DbConnection::setBackend(new SqliteBackend(sqlitePath));
+        auth = true;
     }
 
-    return result;
+    return auth;
 }
 
-void nfcTask(MainWindow* w)
+/**
+ * @brief runExport write the timesheets for a range of days as CSV:
+ *        Signin --export FROM TO [--by day|week|month] [--output FILE], dates as
+ *        yyyy-MM-dd, both included.  With --by, writes each user's hours per period
+ *        instead of every entry.  Writes to stdout without --output.
+ */
+static int runExport(const QStringList &args)
 {
-    // Initialize the database connection for the nfc thread.
-    QSqlDatabase db = QSqlDatabase::addDatabase("QMYSQL");
-    db.setHostName(HOST);
-    db.setDatabaseName(UNAME);
-    db.setUserName(UNAME);
-    db.setPassword(PWD);
-
-    // run this thread forever!
-    while(1)
-    {
-		// do - while loop executes once before checking the condition.
-        do
-        {
-            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-        } while(w->isLoggedIn());  // If there is a user logged in, wait 20ms.
+    QTextStream err(stderr);
 
-        // check for an RFID card swipe.
-        // This blocks this thread for up to 30 seconds waiting for a card swipe.
-        std::string resp = exec("~/libnfc/examples/nfc-poll");
+    int at = args.indexOf("--export");
+    QDate from = at + 1 < args.size() ? QDate::fromString(args[at + 1], "yyyy-MM-dd") : QDate();
+    QDate to = at + 2 < args.size() ? QDate::fromString(args[at + 2], "yyyy-MM-dd") : QDate();
+    if(!from.isValid() || !to.isValid() || to < from)
+    {
+        err << "usage: Signin --export FROM TO [--by day|week|month] [--output FILE]  (dates as yyyy-MM-dd)\n";
+        return 2;
+    }
+
+    int by = args.indexOf("--by");
+    QString periodName = by >= 0 && by + 1 < args.size() ? args[by + 1] : QString();
+    Rollups::Period period = periodName == "day" ? Rollups::Day : periodName == "week" ? Rollups::Week : Rollups::Month;
+    if(by >= 0 && periodName != "day" && periodName != "week" && periodName != "month")
+    {
+        err << "--by takes day, week or month.\n";
+        return 2;
+    }
+
+    QFile file;
+    int output = args.indexOf("--output");
+    bool opened;
+    if(output >= 0 && output + 1 < args.size())
+    {
+        file.setFileName(args[output + 1]);
+        opened = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+    else
+    {
+        opened = file.open(stdout, QIODevice::WriteOnly);
+    }
+
+    if(!opened)
+    {
+        err << "Could not open " << file.fileName() << ": " << file.errorString() << "\n";
+        return 1;
+    }
 
+    Roster roster;
+    Rollups rollups;
+    Timesheet timesheet(&roster, NULL, NULL, NULL, NULL, &rollups);
+    qint64 rows = 0;
+    Timesheet::Result r;
+    if(by >= 0)
+    {
+        // Only the entries that can reach the first period are read.
+        roster.reload();
+        r = timesheet.rebuildRollups(Rollups::periodStart(period, from));
+        if(r == Timesheet::Ok)
+            r = timesheet.exportRollupCsv(period, from, to, &file, rows);
+    }
+    else
+    {
+        r = timesheet.exportCsv(from, to, &file, rows);
+    }
+
+    if(r != Timesheet::Ok)
+    {
+        err << (r == Timesheet::NoConnection ? "Could not connect to the database.\n" : "The export query failed.\n");
+        return 1;
+    }
 
-        if(strcmp(resp.c_str(), "No target found.\n") == 0 || strcmp(resp.c_str(), "") == 0)
+    if(file.error() != QFile::NoError)
+    {
+        err << "Could not write the export: " << file.errorString() << "\n";
+        return 1;
+    }
+
+    err << rows << (by >= 0 ? " lines exported.\n" : " entries exported.\n");
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // The headless modes run without a display.
+    for(int i = 1; i < argc; i++)
+    {
+        QString arg = QString::fromLocal8Bit(argv[i]);
+        if(arg == "--daemon")
         {
-            // This happens when the nfc-poll call times out (every 30ish seconds).
-            continue; // skip back to the start of the while(1) loop.
+            QCoreApplication app(argc, argv);
+            if(!readAuth())
+                qWarning("Could not open Auth File.");
+            return runDaemon(app.arguments());
         }
 
-        w->DisplayMessage("Card Swipe Detected.");
-        //database shouldn't be open--but check just to be sure.
-        if(!db.isOpen())
+        if(arg == "--export")
         {
-            w->DisplayMessage("Re-establishing Database Connection.");
-
-            bool ok = db.open();
-
-            if(!ok)
-            {	// the database failed to connect....
-                w->DisplayMessage("Could Not Connect to Database");
-                continue; // skip back to the beginning of while(1).
-            }
+            QCoreApplication app(argc, argv);
+            if(!readAuth())
+                qWarning("Could not open Auth File.");
+            return runExport(app.arguments());
         }
 
-		// Open a new Query in the database.
-        QSqlQuery q(db);
-        // Look for a user in the database with the RFID corresponding to the swiped card.
-        std::string qstr = "SELECT id, FirstName, LastName FROM user WHERE rfid = " + resp;
-        q.exec(qstr.c_str());
+        if(arg == "--migrate")
+        {
+            QCoreApplication app(argc, argv);
+            if(!readAuth())
+                qWarning("Could not open Auth File.");
+            return runMigration(app.arguments());
+        }
 
-        if(!q.next()) // if the query returned no results.
+        if(arg == "--replay-swipes" || arg == "--rush")
         {
-            std::string msg = "No user with RFID: " + resp;
-            w->DisplayMessage(msg.c_str());
-            continue;
+            QCoreApplication app(argc, argv);
+            return runSwipeReplay(app.arguments());
         }
 
-        // get the ID and name of the person who swiped.  Log in that user.
-        int id = q.value(0).toInt();
-		
-		
-        QString name = "Hello, " + q.value(1).toString() + " " + q.value(2).toString();
-        w->DisplayMessage(name);
-        w->LoadUser(id);
-		
-		// close the database connection.
-        db.close();
+        if(arg == "--simulate-kiosks")
+        {
+            QCoreApplication app(argc, argv);
+            return runKioskSimulation(app.arguments());
+        }
     }
-}
 
-int main(int argc, char *argv[])
-{
-    QApplication a(argc, argv);
+    WatchedApplication a(argc, argv);
     a.setOverrideCursor(QCursor(Qt::BlankCursor));
 
     // Style the buttons so that they are visibly different when disabled
@@ -116,28 +207,60 @@ int main(int argc, char *argv[])
                     "QPushButton { color:rgb(255, 255, 255); }"
                     "QScrollBar:vertical { width: 40px; background-color:lavender; }");
 
-    bool auth = false;
+    bool auth = readAuth();
 
-    // Read the database connection config file.
-	// Config file should be of the form:
-	// |hostname or ip
-	// |database user name
-	// |database user password
-	//
-	// The configuration file is loaded from this address.
-    QFile file("/home/pi/.mysql_auth");
-    if(file.open(QIODevice::ReadOnly | QIODevice::Text))
+    // Latency histograms and error counts, for the monitoring scraper.
+    // SIGNIN_METRICS_FILE moves the file.
+    QString metricsPath = QString::fromLocal8Bit(qgetenv("SIGNIN_METRICS_FILE"));
+    MetricsWriter metrics(metricsPath.isEmpty() ? QString("/home/pi/.signin_metrics") : metricsPath, METRICS_INTERVAL_MS);
+
+    // Log every time the screen stops responding for longer than SIGNIN_STALL_MS
+    // (0 turns it off) and what it was doing; SIGNIN_STALL_LOG moves the log.
+    bool stallOk = false;
+    int stallMs = qgetenv("SIGNIN_STALL_MS").toInt(&stallOk);
+    QString stallPath = QString::fromLocal8Bit(qgetenv("SIGNIN_STALL_LOG"));
+    StallWatchdog watchdog(stallPath.isEmpty() ? QString("/home/pi/.signin_stalls.log") : stallPath,
+                           stallOk ? stallMs : DEFAULT_STALL_MS);
+    watchdog.start();
+
+    // The user table is kept in memory and shared by the window and the nfc thread.
+    Roster roster;
+    OpenSessions sessions;
+    UserTotals totals;
+
+    // With SIGNIN_DAEMON set ("host:port" or a socket path) the jobs go to the punch
+    // daemon, which journals and writes the punches for every kiosk; only the roster
+    // is still read here, so swipes are identified locally.
+    QString daemonAddress = QString::fromLocal8Bit(qgetenv("SIGNIN_DAEMON"));
+    PunchClient *client = daemonAddress.isEmpty() ? NULL : new PunchClient(daemonAddress, &roster);
+
+    // Punches are acknowledged once they are in this journal, and written to the
+    // database in the background, so a database outage does not lose them.
+    PunchJournal journal("/home/pi/.signin_journal");
+    bool journalOk = client || journal.open();
+
+    // Hours per day, week and month for History and 777.  SIGNIN_COLUMN_STORE=1 also
+    // keeps a column copy of timesheet_entry in memory for the 555 report and history.
+    ColumnStore columns;
+    Rollups rollups;
+    JobRunner *worker = client;
+
+    // The roster and who is signed in, as of the last run, so cards are recognized
+    // before the database answers (or while it is down).
+    Snapshot snapshot("/home/pi/.signin_snapshot");
+    bool snapshotOk = true;
+    if(!client)
     {
-        QTextStream in(&file);
-        HOST=in.readLine();
-        UNAME = in.readLine();
-        PWD = in.readLine();
+        snapshotOk = snapshot.load(&roster, &sessions, journalOk ? &journal : NULL);
 
-        file.close();
-        auth = true;
+        DbWorker *local = new DbWorker(&roster, &sessions, journalOk ? &journal : NULL, &totals,
+                                       qgetenv("SIGNIN_COLUMN_STORE") == "1" ? &columns : NULL, &rollups);
+        local->setSnapshot(&snapshot);
+        worker = local;
     }
 
-    MainWindow w(NULL, UNAME, PWD, HOST);
+    MainWindow w(NULL, &roster, client ? NULL : &sessions, client || !journalOk ? NULL : &journal, &totals, worker);
+    w.setStallWatchdog(&watchdog);
     w.showFullScreen();
 
     // if the config file was not accessible, print an error message.
@@ -146,8 +269,50 @@ int main(int argc, char *argv[])
         w.DisplayMessage("Could not open Auth File.");
     }
 
-    // start the nfc thread.
-    std::thread nfc(nfcTask, &w);
+    if(!journalOk)
+    {
+        w.DisplayMessage(journal.lastError());
+    }
+
+    if(!snapshotOk)
+    {
+        qWarning() << snapshot.lastError();
+    }
+
+    // Use scripted fake readers when SIGNIN_FAKE_NFC names scripts, for running
+    // without the hardware.  Otherwise talk to the readers through libnfc;
+    // SIGNIN_NFC_DEVICE can name specific libnfc devices.  Either can list several,
+    // separated by ';'; the first is the kiosk's own reader.
+    ReaderPool readers(&w, &roster);
+    QStringList fakeScripts = QString::fromLocal8Bit(qgetenv("SIGNIN_FAKE_NFC")).split(';', QString::SkipEmptyParts);
+    if(!fakeScripts.isEmpty())
+    {
+        for(int i = 0; i < fakeScripts.size(); i++)
+        {
+            FakeNfcReader *fake = new FakeNfcReader();
+            if(!fake->loadScript(fakeScripts[i]))
+            {
+                w.DisplayMessage(fake->lastError());
+            }
+            readers.addReader(fake);
+        }
+    }
+    else
+    {
+        QStringList devices = QString::fromLocal8Bit(qgetenv("SIGNIN_NFC_DEVICE")).split(';', QString::SkipEmptyParts);
+        if(devices.isEmpty())
+            devices << QString();
 
-    return a.exec();
+        for(int i = 0; i < devices.size(); i++)
+        {
+            readers.addReader(new LibNfcReader(devices[i]));
+        }
+    }
+
+    // start the nfc threads.
+    readers.start();
+
+    int result = a.exec();
+    readers.stop();
+    return result;
 }
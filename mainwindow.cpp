@@ -1,168 +1,244 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
-#include <QtSql/QtSql>
-#include <QtSql/QMYSQLDriver>
-#include <QtSql/QSqlDatabase>
 #include <QDateTime>
-#include <thread>
+#include <QThread>
+#include <QTimer>
+#include "dbconnection.h"
+#include "opensessions.h"
+#include "outputmodel.h"
+#include "metrics.h"
+#include "stallwatchdog.h"
+
+// The output display keeps at most this many lines.
+static const int OUTPUT_MAX_ROWS = 2000;
+// Events from the reader threads waiting for the GUI thread; more than this are dropped.
+static const int UI_EVENT_CAPACITY = 256;
+// DbJob::serial of punches from the other readers, which belong to no keypad session.
+static const int READER_SERIAL = -1;
 
-// TimeSpan stuff.
-// Used in calculations of time on the clock.
-struct timespan
+/**
+ * @brief MainWindow::MainWindow
+ *        Database credentials are set up once in main() through DbConnection::configure.
+ *        All database work runs on a separate DbWorker thread so the keypad stays responsive.
+ * @param parent usually NULL
+ * @param roster in-memory user table shared with the NFC thread.
+ * @param sessions index of who is signed in; the status bar count comes from here.
+ * @param journal local log punches are acknowledged from.
+ * @param totals per user lifetime totals the History button reads.
+ * @param worker runs the jobs instead of a local DbWorker, e.g. a PunchClient.  The
+ *        window takes ownership.
+ */
+MainWindow::MainWindow(QWidget *parent, Roster *roster, OpenSessions *sessions, PunchJournal *journal, UserTotals *totals, JobRunner *worker) :
+    QMainWindow(parent),
+    loggedIn(0),
+    ui(new Ui::MainWindow),
+    uiEvents(UI_EVENT_CAPACITY),
+    drainScheduled(0),
+    stopped(false),
+    watchdog(0)
 {
-    int seconds;
-    int minutes;
-    int hours;
-    int days;
-};
+    this->sessions = sessions;
+
+    idleTimer = new QTimer(this);
+    connect(idleTimer, SIGNAL(timeout()), this, SLOT(idleTimeout()));
+
+    QTimer *timer = new QTimer(this);
+    connect(timer, SIGNAL(timeout()), this, SLOT(updateTime()));
+    timer->start(5000);
+    ui->setupUi(this);
+    output = new OutputModel(OUTPUT_MAX_ROWS, this);
+    ui->output_display->setModel(output);
+    flushScheduled = false;
+    this->userId = -1;
+    pendingJobs = 0;
+    sessionSerial = 0;
+    setActionEnabled(false);
+
+    dbThread = new QThread(this);
+    dbWorker = worker ? worker : new DbWorker(roster, sessions, journal, totals);
+    dbWorker->moveToThread(dbThread);
+    connect(dbThread, SIGNAL(started()), dbWorker, SLOT(start()));
+    connect(dbThread, SIGNAL(finished()), dbWorker, SLOT(deleteLater()));
+    connect(dbWorker, SIGNAL(finished(DbResult)), this, SLOT(dbJobFinished(DbResult)), Qt::QueuedConnection);
+    connect(dbWorker, SIGNAL(waiting(DbResult)), this, SLOT(dbJobWaiting(DbResult)), Qt::QueuedConnection);
+    dbThread->start();
+}
 
 /**
- * @brief addSeconds for use with calculating the time delta between
- *        two QDateTime objects for the time clock calculations.
- *        Use with QDateTime.secsTo(other) to calculate time delta.
- * @param ts - timespan to which seconds will be added
- * @param seconds - number of seconds to add to this timespan.
+ * @brief MainWindow::setStallWatchdog the watchdog keypad command 999 reports from.
+ *        Not owned.
  */
-void addSeconds(timespan &ts, int seconds)
+void MainWindow::setStallWatchdog(StallWatchdog *watchdog)
 {
-    int days = seconds / (24 * 3600);
-    if(days > 0)
-    {
-        ts.days += days;
-        seconds -= days * (24*3600);
-    }
-
-    int hours = seconds / 3600;
-    ts.hours += hours;
-    seconds -= hours * 3600;
+    this->watchdog = watchdog;
+}
 
-    int minutes = seconds / 60;
-    ts.minutes += minutes;
-    seconds -= minutes*60;
+/**
+ * @brief MainWindow::idleTimeout if nothing is done for 30 seconds, clear the display.
+ */
+void MainWindow::idleTimeout()
+{
+    StallTag tag("MainWindow::idleTimeout");
+    ClearMessages();
+    endSession();
+    idleTimer->stop();
+}
 
-    ts.seconds += seconds;
+/**
+ * @brief MainWindow::updateTime show the time and number of people signed in on the status bar.
+ */
+void MainWindow::updateTime()
+{
+    StallTag tag("MainWindow::updateTime");
+    QString msg = QTime().currentTime().toString("hh:mm ap");
 
-    while(ts.seconds>=60)
+    // Without a local index (e.g. when punches go to a punch daemon) there is no count.
+    if(sessions)
     {
-        ts.seconds -= 60;
-        ts.minutes++;
+        msg += QString("\t\tThere are %1 people signed in.").arg(sessions->count());
     }
 
-    while(ts.minutes>=60)
+    // Only mention reconnects once the link has actually dropped.
+    int reconnects = DbConnection::reconnectCount();
+    if(reconnects > 0)
     {
-        ts.minutes-=60;
-        ts.hours++;
+        msg += QString("\t(%1 database reconnects)").arg(reconnects);
     }
 
-    while(ts.hours >= 24)
+    if(pendingJobs > 0)
     {
-        ts.hours-=24;
-        ts.days++;
+        msg += "\tWorking...";
     }
+
+    ui->statusBar->showMessage(msg);
 }
 
 /**
- * @brief Conver the timespan to a string.  Only includes the days field if it is non zero.
- * @param ts
- * @return Human readable representation of the given timespan.
+ * @brief MainWindow::isLoggedIn  Safe to call from any thread.
+ * @return true if there is a user currently logged in.
  */
-QString toString(timespan ts)
+bool MainWindow::isLoggedIn()
 {
-    if(ts.days > 0)
-    {
-        return QString("%1 days, %2 hours, %3 minutes, %4 seconds").arg(ts.days).arg(ts.hours).arg(ts.minutes).arg(ts.seconds);
-    }
-
-    return QString("%1 hours, %2 minutes, %3 seconds").arg(ts.hours).arg(ts.minutes).arg(ts.seconds);
+    return loggedIn.fetchAndAddOrdered(0) != 0;
 }
 
-// End Timespan stuff.
-
 /**
- * @brief MainWindow::MainWindow
- * @param parent usually NULL
- * @param u username/database for the timeclock.
- * @param p password for the user.
- * @param h mysql server host name.
+ * @brief MainWindow::waitWhileLoggedIn block the calling thread until nobody is logged
+ *        in, or stopWaiting() is called.  endSession() wakes it, so the kiosk's reader
+ *        thread sleeps for the whole session and goes back to the reader as soon as it
+ *        ends.  Never call from the GUI thread.
  */
-MainWindow::MainWindow(QWidget *parent, QString u, QString p, QString h) :
-    QMainWindow(parent),
-    ui(new Ui::MainWindow)
+void MainWindow::waitWhileLoggedIn()
 {
-    this->host = h;
-    this->uname = u;
-    this->pwd = p;
-
-    db = QSqlDatabase::addDatabase("QMYSQL", "window_thread");
-    db.setHostName(this->host);
-    db.setDatabaseName(this->uname);
-    db.setUserName(this->uname);
-    db.setPassword(this->pwd);
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-
-    if(!ok)
+    QMutexLocker locker(&sessionLock);
+    while(loggedIn.fetchAndAddOrdered(0) != 0 && !stopped)
     {
-        DisplayMessage("Could Not Connect to Database...");
-        return;
-    }
-
-    QSqlQuery query(db);
-    QString qstr = QString("SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE TimeIn>CURDATE() AND TimeIn=TimeOut");
-    query.exec(qstr);
-
-    signInCount = 0;
-    while(query.next())
-    {
-        signInCount++;
+        sessionEnded.wait(&sessionLock);
     }
-
-    db.close();
-
-    idleTimer = new QTimer(this);
-    connect(idleTimer, SIGNAL(timeout()), this, SLOT(idleTimeout()));
-
-    QTimer *timer = new QTimer(this);
-    connect(timer, SIGNAL(timeout()), this, SLOT(updateTime()));
-    timer->start(5000);
-    ui->setupUi(this);
-    setActionEnabled(false);
-    this->loggedIn = false;
 }
 
 /**
- * @brief MainWindow::idleTimeout if nothing is done for 30 seconds, clear the display.
+ * @brief MainWindow::stopWaiting release every thread in waitWhileLoggedIn(), now and
+ *        from now on, so the reader threads can be shut down.
  */
-void MainWindow::idleTimeout()
+void MainWindow::stopWaiting()
 {
-    ClearMessages();
-    ui->keypad_display->display(0);
-    setActionEnabled(false);
-    loggedIn = false;
-    userId = -1;
-    idleTimer->stop();
+    QMutexLocker locker(&sessionLock);
+    stopped = true;
+    sessionEnded.wakeAll();
 }
 
 /**
- * @brief MainWindow::updateTime show the time and number of people signed in on the status bar.
+ * @brief MainWindow::postUiEvent hand an event to the GUI thread.  Safe to call from any
+ *        thread; this is how the reader threads talk to the window.  Events posted in a
+ *        burst are handled together the next time the event loop runs.
+ * @param type what happened.
+ * @param text the name, RFID or error message that goes with it.
+ * @param userId for UserResolved, the user to log in or punch.
+ * @param reader which reader it happened at; 0 is the kiosk's own.
  */
-void MainWindow::updateTime()
+void MainWindow::postUiEvent(UiEvent::Type type, const QString &text, int userId, int reader)
 {
-    ui->statusBar->showMessage(QTime().currentTime().toString("hh:mm ap") + QString("\t\tThere are %1 people signed in.").arg(signInCount));
+    UiEvent event;
+    event.type = type;
+    event.userId = userId;
+    event.reader = reader;
+    event.text = text;
+    uiEvents.push(event);
+
+    if(drainScheduled.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "drainUiEvents", Qt::QueuedConnection);
 }
 
 /**
- * @brief MainWindow::isLoggedIn
- * @return true if there is a user currently logged in.
+ * @brief MainWindow::drainUiEvents handle every event posted since the last drain.
+ *        A message repeated back to back is only shown once.  A card resolved at the
+ *        kiosk reader logs the user in; at any other reader it is punched right away.
  */
-bool MainWindow::isLoggedIn()
+void MainWindow::drainUiEvents()
 {
-    return loggedIn;
+    StallTag tag("MainWindow::drainUiEvents");
+    // Reset first: anything posted from here on schedules another drain.
+    drainScheduled.fetchAndStoreOrdered(0);
+
+    UiEvent event;
+    bool havePrevious = false;
+    UiEvent::Type previousType = UiEvent::Error;
+    int previousReader = 0;
+    QString previousText;
+
+    while(uiEvents.pop(event))
+    {
+        if(havePrevious && event.type == previousType && event.reader == previousReader
+                && event.text == previousText && event.type != UiEvent::UserResolved)
+            continue;
+
+        havePrevious = true;
+        previousType = event.type;
+        previousReader = event.reader;
+        previousText = event.text;
+
+        QString prefix = event.reader > 0 ? QString("Reader %1: ").arg(event.reader + 1) : QString();
+
+        switch(event.type)
+        {
+        case UiEvent::CardDetected:
+            DisplayMessage(prefix + "Card Swipe Detected.");
+            break;
+        case UiEvent::UserResolved:
+            if(event.reader > 0)
+            {
+                submitReaderPunch(event.userId, event.reader);
+                break;
+            }
+
+            // Someone may have logged in on the keypad while the card was looked up.
+            if(isLoggedIn())
+                break;
+            DisplayMessage("Hello, " + event.text);
+            LoadUser(event.userId);
+            break;
+        case UiEvent::UnknownCard:
+            DisplayMessage(prefix + "No user with RFID: " + event.text);
+            break;
+        case UiEvent::Error:
+            DisplayMessage(prefix + event.text);
+            break;
+        }
+    }
+
+    int dropped = uiEvents.takeDropped();
+    if(dropped > 0)
+    {
+        Metrics::count(Metrics::UiEventsDropped, dropped);
+        DisplayMessage(QString("(%1 card reader messages dropped)").arg(dropped));
+    }
 }
 
 MainWindow::~MainWindow()
 {
-    delete db;
+    dbThread->quit();
+    dbThread->wait();
     delete ui;
 }
 
@@ -172,33 +248,201 @@ MainWindow::~MainWindow()
  */
 void MainWindow::LoadUser(int id)
 {
-    setActionEnabled(true);
-    loggedIn = true;
+    sessionLock.lock();
+    loggedIn.fetchAndStoreOrdered(1);
+    sessionLock.unlock();
+
     userId = id;
+    setActionEnabled(true);
     DisplayMessage("Ready.");
 }
 
+/**
+ * @brief MainWindow::endSession log out the current user and reset the keypad.
+ *        Results from jobs submitted during the old session are no longer displayed.
+ */
+void MainWindow::endSession()
+{
+    ui->keypad_display->display(0);
+    userId = -1;
+    sessionSerial++;
+
+    sessionLock.lock();
+    loggedIn.fetchAndStoreOrdered(0);
+    sessionEnded.wakeAll();
+    sessionLock.unlock();
+
+    setActionEnabled(false);
+}
+
 /**
  * @brief MainWindow::setActionEnabled sets the enabled field on each of the action buttons.
+ *        While a database job is running the action buttons and OK stay disabled; the
+ *        number keys and Clear are always available.
  * @param enable enable or disable the action buttons.
  */
 void MainWindow::setActionEnabled(bool enable)
 {
+    enable = enable && pendingJobs == 0;
+
     ui->btn_signin->setEnabled(enable);
     ui->btn_signout->setEnabled(enable);
     ui->btn_status->setEnabled(enable);
     ui->btn_history->setEnabled(enable);
+    ui->btn_accept->setEnabled(pendingJobs == 0);
+}
+
+/**
+ * @brief MainWindow::submitJob hand a job to the database thread and show the working state.
+ * @param type what to do.
+ * @param id user.id the job is for, if any.
+ */
+void MainWindow::submitJob(DbJob::Type type, int id)
+{
+    DbJob job;
+    job.type = type;
+    job.userId = id;
+    job.serial = sessionSerial;
+    job.reader = 0;
+
+    pendingJobs++;
+    setActionEnabled(isLoggedIn());
+    updateTime();
+    dbWorker->submit(job);
+}
+
+/**
+ * @brief MainWindow::submitReaderPunch sign a user in or out for a swipe at one of the
+ *        other readers.  It does not touch the keypad session, and its result is shown
+ *        whatever the keypad is doing.
+ * @param id user.id of the person who swiped.
+ * @param reader ReaderPool index of the reader.
+ */
+void MainWindow::submitReaderPunch(int id, int reader)
+{
+    DbJob job;
+    job.type = DbJob::Toggle;
+    job.userId = id;
+    job.serial = READER_SERIAL;
+    job.reader = reader;
+    dbWorker->submit(job);
+}
+
+/**
+ * @brief MainWindow::dbJobFinished show the result of a database job.
+ *        Output from a session that has since been cleared or timed out is dropped,
+ *        except for punches that were held up, which are always shown.
+ * @param result what the DbWorker produced.
+ */
+void MainWindow::dbJobFinished(DbResult result)
+{
+    StallTag tag("MainWindow::dbJobFinished");
+
+    // Reader punches hold up nothing, and a waited job was released by dbJobWaiting.
+    if(result.job.serial == READER_SERIAL || result.waited)
+    {
+        DisplayMessages(result.lines);
+        updateTime();
+        return;
+    }
+
+    pendingJobs--;
+
+    if(result.job.serial == sessionSerial)
+    {
+        DisplayMessages(result.lines);
+
+        if(result.success)
+        {
+            switch(result.job.type)
+            {
+            case DbJob::LookupUser:
+                LoadUser(result.job.userId);
+                break;
+            case DbJob::SignIn:
+            case DbJob::SignOut:
+                endSession();
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    setActionEnabled(isLoggedIn());
+    updateTime();
+}
+
+/**
+ * @brief MainWindow::dbJobWaiting show why a job is held up.  A held punch will still be
+ *        made, so it counts as accepted: the session ends and the keypad is free again
+ *        instead of waiting for the server.  Its dbJobFinished, which comes later, only
+ *        shows the result.
+ */
+void MainWindow::dbJobWaiting(DbResult result)
+{
+    StallTag tag("MainWindow::dbJobWaiting");
+    if(result.job.serial == READER_SERIAL)
+    {
+        DisplayMessages(result.lines);
+        return;
+    }
+
+    pendingJobs--;
+
+    if(result.job.serial == sessionSerial)
+    {
+        DisplayMessages(result.lines);
+        endSession();
+    }
+
+    setActionEnabled(isLoggedIn());
+    updateTime();
 }
 
 /**
  * @brief MainWindow::DisplayMessage displays a message in the output_display.
- *        This also triggers the idleTimer to start.
+ *        Messages are collected and shown together once control returns to the event
+ *        loop, which also (re)starts the idleTimer.  GUI thread only; other threads use
+ *        postUiEvent().
  * @param msg Message to be displayed.
  */
 void MainWindow::DisplayMessage(QString msg)
 {
-    idleTimer->stop();
-    ui->output_display->append(msg);
+    DisplayMessages(QStringList(msg));
+}
+
+/**
+ * @brief MainWindow::DisplayMessages displays several messages as one batch.
+ */
+void MainWindow::DisplayMessages(const QStringList &msgs)
+{
+    if(msgs.isEmpty())
+        return;
+
+    pendingLines.append(msgs);
+    if(!flushScheduled)
+    {
+        flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flushMessages", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief MainWindow::flushMessages add the collected messages to the output_display in
+ *        one update and scroll to the newest.
+ */
+void MainWindow::flushMessages()
+{
+    StallTag tag("MainWindow::flushMessages");
+    flushScheduled = false;
+    if(pendingLines.isEmpty())
+        return;
+
+    MetricsTimer timer(Metrics::UiRender);
+    output->appendLines(pendingLines);
+    pendingLines.clear();
+    ui->output_display->scrollToBottom();
     idleTimer->start(30000);
 }
 
@@ -207,7 +451,8 @@ void MainWindow::DisplayMessage(QString msg)
  */
 void MainWindow::ClearMessages()
 {
-    ui->output_display->clear();
+    pendingLines.clear();
+    output->clear();
 }
 
 void MainWindow::on_btn_0_clicked()
@@ -291,11 +536,9 @@ void MainWindow::on_btn_9_clicked()
 
 void MainWindow::on_btn_clear_clicked()
 {
-    ui->keypad_display->display(0);
-    ui->output_display->clear();
-    userId = -1;
-    loggedIn = false;
-    setActionEnabled(false);
+    StallTag tag("MainWindow::on_btn_clear_clicked");
+    ClearMessages();
+    endSession();
 }
 
 /**
@@ -306,27 +549,7 @@ void MainWindow::displayUserIds()
     ClearMessages();
     DisplayMessage("Getting User Ids");
     DisplayMessage("________________________________");
-
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-
-    if(!ok)
-    {
-        DisplayMessage("Could Not Connect to Database...");
-        return;
-    }
-
-    QSqlQuery query(db);
-    QString qstr = "SELECT id, FirstName, LastName FROM user ORDER BY LastName";
-    query.exec(qstr);
-
-    while(query.next())
-    {
-        QString line = QString("%1 -- %2 %3").arg(query.value(0).toInt()).arg(query.value(1).toString()).arg(query.value(2).toString());
-        DisplayMessage(line);
-    }
-
-    db.close();
+    submitJob(DbJob::ListUsers);
 }
 
 /**
@@ -337,35 +560,7 @@ void MainWindow::displayCurrentSignIns()
     ClearMessages();
     DisplayMessage("Currently Signed In:");
     DisplayMessage("________________________________");
-
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-
-    if(!ok)
-    {
-        DisplayMessage("Could Not Connect to Database...");
-        return;
-    }
-
-    QSqlQuery query(db);
-    QString qstr = QString("SELECT a.FirstName, a.LastName, b.TimeIn FROM user a, timesheet_entry b ") +
-                   QString("WHERE a.id=b.userId AND b.TimeIn>CURDATE() AND b.TimeIn=b.TimeOut");
-    query.exec(qstr);
-
-    while(query.next())
-    {
-        QDateTime ti = query.value(2).toDateTime();
-        timespan ts;
-        ts.days=0;
-        ts.hours=0;
-        ts.minutes=0;
-        ts.seconds=0;
-        addSeconds(ts, ti.secsTo(ti.currentDateTime()));
-        QString line = QString("%1 %2 -- %3").arg(query.value(0).toString()).arg(query.value(1).toString()).arg(toString(ts));
-        DisplayMessage(line);
-    }
-
-    db.close();
+    submitJob(DbJob::CurrentSignIns);
 }
 
 /**
@@ -376,59 +571,47 @@ void MainWindow::showAllStats()
     ClearMessages();
     DisplayMessage("Stats for all Users:");
     DisplayMessage("________________________________");
+    submitJob(DbJob::AllStats);
+}
 
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-
-    if(!ok)
-    {
-        DisplayMessage("Could Not Connect to Database...");
-        return;
-    }
-
-    QSqlQuery query(db);
-    QString qstr = "SELECT id, FirstName, LastName FROM user ORDER BY LastName";
-    query.exec(qstr);
-
-    while(query.next())
-    {
-        int usrid = query.value(0).toInt();
-        QString fname = query.value(1).toString();
-        QString lname = query.value(2).toString();
-
-        DisplayMessage(fname + " " + lname);
-        qstr = QString("SELECT TimeIn, TimeOut FROM timesheet_entry WHERE userId=%1").arg(usrid);
-        QSqlQuery q2(db);
-        q2.exec(qstr);
-        timespan timeOn;
-        timeOn.seconds=0;
-        timeOn.minutes=0;
-        timeOn.hours=0;
-        timeOn.days=0;
-        int notSignedOutCount = 0;
-
-        while(q2.next())
-        {
-            QDateTime ti = q2.value(0).toDateTime();
-            QDateTime to = q2.value(1).toDateTime();
-            if (to <= ti)
-            {
-                notSignedOutCount++;
-                continue;
-            }
-
-            addSeconds(timeOn, ti.secsTo(to));
-        }
+/**
+ * @brief MainWindow::verifyTotals checks the History totals kept in memory against a
+ *        full recount from the database, then rebuilds them.
+ */
+void MainWindow::verifyTotals()
+{
+    ClearMessages();
+    DisplayMessage("Checking History Totals:");
+    DisplayMessage("________________________________");
+    submitJob(DbJob::VerifyTotals);
+}
 
-        DisplayMessage(QString("%1 (%2)").arg(toString(timeOn)).arg(notSignedOutCount));
-        DisplayMessage("__________________________");
-    }
+/**
+ * @brief MainWindow::showPeriodHours shows everyone's hours this week, last week and
+ *        this month, for checking eligibility.
+ */
+void MainWindow::showPeriodHours()
+{
+    ClearMessages();
+    DisplayMessage("Hours by Week and Month:");
+    DisplayMessage("________________________________");
+    submitJob(DbJob::PeriodHours);
+}
 
 
-    db.close();
+/**
+ * @brief MainWindow::showStalls show what the StallWatchdog has caught.  Runs on the GUI
+ *        thread; the report is only a copy of what the watchdog already collected.
+ */
+void MainWindow::showStalls()
+{
+    ClearMessages();
+    if(watchdog)
+        DisplayMessages(watchdog->report());
+    else
+        DisplayMessage("The stall watchdog is off.");
 }
 
-
 /**
  * @brief MainWindow::printHelp displays the list of special comands.
  */
@@ -442,6 +625,9 @@ void MainWindow::printHelp()
     DisplayMessage("1111:\tPrint the list of User IDs.");
     DisplayMessage("1234:\tShow who is currently Signed In.");
     DisplayMessage("555:\tDisplay Signin Totals for all Users.");
+    DisplayMessage("556:\tCheck and rebuild the History totals.");
+    DisplayMessage("777:\tShow hours this week, last week and this month.");
+    DisplayMessage("999:\tShow when the screen froze and what it was doing.");
 }
 
 /**
@@ -450,6 +636,8 @@ void MainWindow::printHelp()
  */
 void MainWindow::on_btn_accept_clicked()
 {
+    StallTag tag("MainWindow::on_btn_accept_clicked");
+
     // Special Commands!
 
     if(ui->keypad_display->intValue()==0)
@@ -479,34 +667,30 @@ void MainWindow::on_btn_accept_clicked()
         return;
     }
 
-    // End Special Commands
-
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-    if(!ok)
+    if(ui->keypad_display->intValue()==556)
     {
-        DisplayMessage("Could Not Connect to Database...");
+        verifyTotals();
+        ui->keypad_display->display(0);
         return;
     }
 
-    int usrid = ui->keypad_display->intValue();
-    QString idstr = QString::number(usrid);
+    if(ui->keypad_display->intValue()==777)
+    {
+        showPeriodHours();
+        ui->keypad_display->display(0);
+        return;
+    }
 
-    QSqlQuery q(db);
-    QString qstr = QString("SELECT FirstName, LastName FROM user WHERE id = ") + idstr;
-    q.exec(qstr);
-    if(!q.next())
+    if(ui->keypad_display->intValue()==999)
     {
-        QString msg = QString("Invalid Id: ") + idstr;
-        DisplayMessage(msg);
-        DisplayMessage("Type 1111 to see the list of ID numbers.");
+        showStalls();
+        ui->keypad_display->display(0);
         return;
     }
 
-    QString name = "Hello, " + q.value(0).toString() + " " + q.value(1).toString();
-    DisplayMessage(name);
-    LoadUser(usrid);
-    db.close();
+    // End Special Commands
+
+    submitJob(DbJob::LookupUser, ui->keypad_display->intValue());
 }
 
 /**
@@ -515,40 +699,8 @@ void MainWindow::on_btn_accept_clicked()
  */
 void MainWindow::on_btn_signin_clicked()
 {
-
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-    if(!ok)
-    {
-        ui->output_display->append("Failed to connect to database...");
-        return;
-    }
-
-    QString idstr = QString::number(userId);
-
-    QSqlQuery query(db);
-    QString qstr = QString("SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=") + idstr + QString(" AND TimeIn>CURDATE() AND TimeIn=TimeOut");
-    query.exec(qstr);
-
-    if(!query.next())
-    {
-        qstr = QString("INSERT INTO timesheet_entry (TimeIn, TimeOut, userId) VALUES (NOW(), NOW(), ") + idstr + QString(")");
-        query.exec(qstr);
-        loggedIn = false;
-        userId = -1;
-        setActionEnabled(false);
-        ui->keypad_display->display(0);
-        DisplayMessage("Successfully Signed in at:");
-        DisplayMessage(QDateTime().currentDateTime().toString());
-        signInCount++;
-    }
-    else
-    {
-       DisplayMessage("You are already signed in!");
-    }
-
-    db.close();
-
+    StallTag tag("MainWindow::on_btn_signin_clicked");
+    submitJob(DbJob::SignIn, userId);
 }
 
 /**
@@ -557,40 +709,8 @@ void MainWindow::on_btn_signin_clicked()
  */
 void MainWindow::on_btn_signout_clicked()
 {
-
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-    if(!ok)
-    {
-        ui->output_display->append("Failed to connect to database...");
-        return;
-    }
-
-    QString idstr = QString::number(userId);
-
-    QSqlQuery query(db);
-    QString qstr = QString("SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=") + idstr + QString(" AND TimeIn>CURDATE() AND TimeIn=TimeOut");
-    query.exec(qstr);
-
-    int teid = -1;
-
-    if(!query.next())
-    {
-        DisplayMessage("You are not currently signed in.");
-    }
-    else
-    {
-        teid = query.value(0).toInt();
-        qstr = "UPDATE timesheet_entry SET TimeOut=NOW() WHERE id=" + QString::number(teid);
-        query.exec(qstr);
-        loggedIn = false;
-        userId = -1;
-        setActionEnabled(false);
-        ui->keypad_display->display(0);
-        DisplayMessage("Sucessfully Signed Out.");
-        signInCount--;
-    }
-    db.close();
+    StallTag tag("MainWindow::on_btn_signout_clicked");
+    submitJob(DbJob::SignOut, userId);
 }
 
 /**
@@ -599,37 +719,8 @@ void MainWindow::on_btn_signout_clicked()
  */
 void MainWindow::on_btn_status_clicked()
 {
-
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-    if(!ok)
-    {
-        ui->output_display->append("Failed to connect to database...");
-        return;
-    }
-
-    QString idstr = QString::number(userId);
-
-    QSqlQuery query(db);
-    QString qstr = QString("SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=") + idstr + QString(" AND TimeIn>CURDATE() AND TimeIn=TimeOut");
-    query.exec(qstr);
-
-    if(!query.next())
-    {
-        DisplayMessage("You are currently signed out.");
-    }
-    else
-    {
-        QDateTime dt = query.value(1).toDateTime();
-        int seconds = dt.secsTo(dt.currentDateTime());
-        int hours = seconds / 3600;
-        seconds -= hours * 3600;
-        int minutes = seconds / 60;
-
-        DisplayMessage(QString("You have been signed in for %1 hours, %2 minutes.").arg(hours).arg(minutes));
-    }
-
-    db.close();
+    StallTag tag("MainWindow::on_btn_status_clicked");
+    submitJob(DbJob::Status, userId);
 }
 
 /**
@@ -638,44 +729,6 @@ void MainWindow::on_btn_status_clicked()
  */
 void MainWindow::on_btn_history_clicked()
 {
-
-    bool ok = db.open();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(20));
-    if(!ok)
-    {
-        ui->output_display->append("Failed to connect to database...");
-        return;
-    }
-
-    QString idstr = QString::number(userId);
-
-    QSqlQuery query(db);
-    QString qstr = QString("SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=") + idstr;
-    query.exec(qstr);
-
-    timespan timeOn;
-    timeOn.seconds=0;
-    timeOn.minutes=0;
-    timeOn.hours=0;
-    timeOn.days=0;
-    int notSignedOutCount = 0;
-
-    while(query.next())
-    {
-        QDateTime ti = query.value(1).toDateTime();
-        QDateTime to = query.value(2).toDateTime();
-        if (to <= ti)
-        {
-            notSignedOutCount++;
-            continue;
-        }
-
-        addSeconds(timeOn, ti.secsTo(to));
-    }
-
-    DisplayMessage("You have been signed on for:");
-    DisplayMessage(toString(timeOn));
-    DisplayMessage(QString("You have forgotten to sign out %1 times...").arg(notSignedOutCount));
-
-    db.close();
+    StallTag tag("MainWindow::on_btn_history_clicked");
+    submitJob(DbJob::History, userId);
 }
@@ -2,38 +2,56 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QSqlDatabase>
+#include <QMutex>
+#include <QWaitCondition>
+#include "dbworker.h"
+#include "readerpool.h"
+#include "uieventqueue.h"
+
+class QThread;
+class OutputModel;
+class StallWatchdog;
 
 namespace Ui {
 class MainWindow;
 }
 
-class MainWindow : public QMainWindow
+class MainWindow : public QMainWindow, public SwipeSink
 {
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = 0, QString u = "database name", QString p = "password", QString h = "host");
+    explicit MainWindow(QWidget *parent = 0, Roster *roster = 0, OpenSessions *sessions = 0, PunchJournal *journal = 0, UserTotals *totals = 0, JobRunner *worker = 0);
     ~MainWindow();
     void DisplayMessage(QString msg);
+    void DisplayMessages(const QStringList &msgs);
     void ClearMessages();
     void LoadUser(int id);
     bool isLoggedIn();
+    void waitWhileLoggedIn();
+    void stopWaiting();
+    void postUiEvent(UiEvent::Type type, const QString &text = QString(), int userId = -1, int reader = 0);
     void setCreds(QString n, QString p);
+    void setStallWatchdog(StallWatchdog *watchdog);
 
 private:
-    bool loggedIn;
+    QAtomicInt loggedIn;     // read by the NFC thread.
     int userId;
-    int signInCount;
+    int pendingJobs;
+    int sessionSerial;
+    bool flushScheduled;
+    QStringList pendingLines;
     void setActionEnabled(bool enable);
+    void endSession();
+    void submitJob(DbJob::Type type, int id = -1);
+    void submitReaderPunch(int id, int reader);
     void displayUserIds();
     void displayCurrentSignIns();
     void showAllStats();
+    void verifyTotals();
+    void showPeriodHours();
+    void showStalls();
     void printHelp();
-    QString host;
-    QString uname;
-    QString pwd;
-    QSqlDatabase db;
 
 private slots:
     void on_btn_0_clicked();
@@ -72,9 +90,27 @@ private slots:
 
     void idleTimeout();
 
+    void dbJobFinished(DbResult result);
+
+    void dbJobWaiting(DbResult result);
+
+    void flushMessages();
+
+    void drainUiEvents();
+
 private:
     Ui::MainWindow *ui;
     QTimer *idleTimer;
+    OutputModel *output;
+    OpenSessions *sessions;
+    QThread *dbThread;
+    JobRunner *dbWorker;
+    UiEventQueue uiEvents;
+    QAtomicInt drainScheduled;
+    QMutex sessionLock;
+    QWaitCondition sessionEnded;
+    bool stopped;   // guarded by sessionLock.
+    StallWatchdog *watchdog;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,156 @@
+#include "metrics.h"
+#include <QAtomicInt>
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+#include <QTimer>
+#include <atomic>
+#include <cstdio>
+
+// Bucket 0 holds anything up to 1 us, bucket i anything up to 2^i us, matching the
+// exported le labels; the last bucket (over about 8 s) catches the rest.
+static const int BUCKETS = 25;
+
+static const char *STAGE_NAMES[Metrics::StageCount] = {
+    "reader_poll",
+    "user_resolve",
+    "db_connect",
+    "job_lookup_user",
+    "job_sign_in",
+    "job_sign_out",
+    "job_status",
+    "job_history",
+    "job_list_users",
+    "job_current_sign_ins",
+    "job_all_stats",
+    "job_verify_totals",
+    "job_toggle",
+    "job_period_hours",
+    "journal_append",
+    "punch_write",
+    "ui_render",
+    "daemon_round_trip",
+    "event_loop_lag"
+};
+
+static const char *COUNTER_NAMES[Metrics::CounterCount] = {
+    "query_errors",
+    "reconnects",
+    "connect_failures",
+    "reader_errors",
+    "journal_errors",
+    "ui_events_dropped",
+    "daemon_timeouts",
+    "ui_stalls"
+};
+
+/**
+ * @brief One stage's histogram.  The sum is kept in nanoseconds, 64 bits wide, so
+ *        sub-millisecond stages still add up; the counts may eventually wrap.
+ */
+struct Histogram
+{
+    QAtomicInt buckets[BUCKETS];
+    QAtomicInt count;
+    std::atomic<qint64> sumNanos;
+};
+
+static Histogram histograms[Metrics::StageCount];
+static QAtomicInt counters[Metrics::CounterCount];
+
+/**
+ * @brief Metrics::record add one observation.  Safe to call from any thread.
+ * @param nanos how long the stage took, e.g. from QElapsedTimer::nsecsElapsed().
+ */
+void Metrics::record(Stage stage, qint64 nanos)
+{
+    if(nanos < 0)
+        nanos = 0;
+
+    // The smallest bucket whose bound, 2^b us, is at least the observation.
+    quint64 us = ((quint64)nanos + 999) / 1000;
+    int bucket = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+    if(bucket >= BUCKETS)
+        bucket = BUCKETS - 1;
+
+    Histogram &h = histograms[stage];
+    h.buckets[bucket].fetchAndAddRelaxed(1);
+    h.count.fetchAndAddRelaxed(1);
+    h.sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Metrics::count bump a counter.  Safe to call from any thread.
+ */
+void Metrics::count(Counter counter, int n)
+{
+    counters[counter].fetchAndAddRelaxed(n);
+}
+
+/**
+ * @brief Metrics::writeFile write every histogram and counter to path, replacing the
+ *        old file in one rename.
+ * @return false if the file could not be written.
+ */
+bool Metrics::writeFile(const QString &path)
+{
+    QString tmpPath = path + ".tmp";
+    QFile file(tmpPath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+    out << "# TYPE signin_latency_seconds histogram\n";
+    for(int s = 0; s < StageCount; s++)
+    {
+        Histogram &h = histograms[s];
+        int cumulative = 0;
+        for(int b = 0; b < BUCKETS; b++)
+        {
+            cumulative += h.buckets[b].fetchAndAddRelaxed(0);
+            QString le = b == BUCKETS - 1 ? QString("+Inf") : QString::number((double)(1 << b) / 1e6, 'g', 8);
+            out << "signin_latency_seconds_bucket{stage=\"" << STAGE_NAMES[s] << "\",le=\"" << le << "\"} " << cumulative << "\n";
+        }
+
+        // Taken after the buckets, so count is never less than the +Inf bucket.
+        out << "signin_latency_seconds_count{stage=\"" << STAGE_NAMES[s] << "\"} " << qMax(cumulative, h.count.fetchAndAddRelaxed(0)) << "\n";
+        out << "signin_latency_seconds_sum{stage=\"" << STAGE_NAMES[s] << "\"} " << QString::number(h.sumNanos.load(std::memory_order_relaxed) / 1e9, 'f', 6) << "\n";
+    }
+
+    out << "# TYPE signin_events_total counter\n";
+    for(int c = 0; c < CounterCount; c++)
+    {
+        out << "signin_events_total{event=\"" << COUNTER_NAMES[c] << "\"} " << counters[c].fetchAndAddRelaxed(0) << "\n";
+    }
+
+    out.flush();
+    file.close();
+    if(file.error() != QFile::NoError)
+        return false;
+
+    return ::rename(QFile::encodeName(tmpPath).constData(), QFile::encodeName(path).constData()) == 0;
+}
+
+/**
+ * @brief MetricsWriter::MetricsWriter
+ * @param path file the monitoring scraper reads.
+ * @param intervalMs how often it is rewritten.
+ */
+MetricsWriter::MetricsWriter(QString path, int intervalMs, QObject *parent) :
+    QObject(parent),
+    path(path),
+    reportedError(false)
+{
+    timer = new QTimer(this);
+    connect(timer, SIGNAL(timeout()), this, SLOT(write()));
+    timer->start(intervalMs);
+}
+
+void MetricsWriter::write()
+{
+    bool ok = Metrics::writeFile(path);
+    if(!ok && !reportedError)
+        qWarning() << "Could not write metrics file" << path;
+
+    reportedError = !ok;
+}
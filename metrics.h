@@ -0,0 +1,98 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+
+class QTimer;
+
+/**
+ * @brief The Metrics class keeps latency histograms for each stage of a punch, and
+ *        counts of things going wrong, for the monitoring scraper.
+ *
+ *        Recording is a handful of relaxed atomic adds into fixed power-of-two buckets
+ *        (in microseconds), so it is safe from any thread and cheap enough for the punch
+ *        path.  writeFile() renders everything in the Prometheus text format.
+ */
+class Metrics
+{
+public:
+    enum Stage
+    {
+        ReaderPoll,         // a poll that read a card.
+        UserResolve,        // card -> user, roster or database.
+        DbConnect,          // opening (or reopening) a connection.
+        JobLookupUser,      // DbWorker jobs, in DbJob::Type order.
+        JobSignIn,
+        JobSignOut,
+        JobStatus,
+        JobHistory,
+        JobListUsers,
+        JobCurrentSignIns,
+        JobAllStats,
+        JobVerifyTotals,
+        JobToggle,
+        JobPeriodHours,
+        JournalAppend,      // writing (and syncing) one punch to the journal.
+        PunchWrite,         // one group commit of punches to timesheet_entry.
+        UiRender,           // adding a batch of lines to the output display.
+        DaemonRoundTrip,    // a kiosk's request to the punch daemon until its answer.
+        EventLoopLag,       // how late the GUI thread's event loop ran a StallWatchdog tick.
+        StageCount
+    };
+
+    enum Counter
+    {
+        QueryErrors,
+        Reconnects,
+        ConnectFailures,
+        ReaderErrors,
+        JournalErrors,
+        UiEventsDropped,
+        DaemonTimeouts,
+        UiStalls,
+        CounterCount
+    };
+
+    static void record(Stage stage, qint64 nanos);
+    static void count(Counter counter, int n = 1);
+    static bool writeFile(const QString &path);
+};
+
+/**
+ * @brief The MetricsTimer class records the time from its construction to its
+ *        destruction against a stage.
+ */
+class MetricsTimer
+{
+public:
+    explicit MetricsTimer(Metrics::Stage stage) : stage(stage) { timer.start(); }
+    ~MetricsTimer() { Metrics::record(stage, timer.nsecsElapsed()); }
+
+private:
+    Metrics::Stage stage;
+    QElapsedTimer timer;
+};
+
+/**
+ * @brief The MetricsWriter class rewrites the metrics file every intervalMs on the thread
+ *        it lives on.  The file is replaced atomically, so a scraper never sees half of it.
+ */
+class MetricsWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    MetricsWriter(QString path, int intervalMs, QObject *parent = 0);
+
+private slots:
+    void write();
+
+private:
+    QString path;
+    QTimer *timer;
+    bool reportedError;
+};
+
+#endif // METRICS_H
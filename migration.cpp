@@ -0,0 +1,303 @@
+#include "migration.h"
+#include "dbconnection.h"
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QTextStream>
+#include <QVariant>
+#include <cstdio>
+
+// Each query is timed this many times and the fastest run is reported, so a cold
+// buffer pool on the first run does not hide the index.
+static const int TIMING_RUNS = 5;
+
+/**
+ * @brief A query the kiosk runs on every swipe or report, with sample values in
+ *        place of its bound parameters.  flagSql is the form Timesheet switches to once
+ *        IsOpen exists; empty if the query does not change.
+ */
+struct Probe
+{
+    const char *name;
+    const char *sql;
+    const char *flagSql;
+};
+
+static const Probe PROBES[] = {
+    { "card lookup",
+      "SELECT id, FirstName, LastName FROM user WHERE rfid = '0'",
+      "" },
+    { "open entry",
+      "SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=1 AND TimeIn>CURDATE() AND TimeIn=TimeOut",
+      "SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=1 AND TimeIn>CURDATE() AND IsOpen=1" },
+    { "signed in list",
+      "SELECT b.id, a.id, a.FirstName, a.LastName, b.TimeIn FROM user a, timesheet_entry b "
+      "WHERE a.id=b.userId AND b.TimeIn>CURDATE() AND b.TimeIn=b.TimeOut",
+      "SELECT b.id, a.id, a.FirstName, a.LastName, b.TimeIn FROM user a, timesheet_entry b "
+      "WHERE a.id=b.userId AND b.TimeIn>CURDATE() AND b.IsOpen=1" },
+    { "history",
+      "SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=1",
+      "" }
+};
+
+static const int PROBE_COUNT = sizeof(PROBES) / sizeof(PROBES[0]);
+
+/**
+ * @brief A change to make, if check finds nothing.  check returns a row when the
+ *        change is already in place.
+ */
+struct Change
+{
+    const char *name;
+    const char *check;
+    const char *sql;
+    bool needsFlag;     // only once IsOpen exists.
+};
+
+static const Change CHANGES[] = {
+    { "user (rfid) index",
+      "SHOW INDEX FROM user WHERE Column_name='rfid' AND Seq_in_index=1",
+      "ALTER TABLE user ADD INDEX rfid_idx (rfid)",
+      false },
+    { "timesheet_entry (userId, TimeIn) index",
+      "SHOW INDEX FROM timesheet_entry WHERE Key_name='user_time_idx'",
+      "ALTER TABLE timesheet_entry ADD INDEX user_time_idx (userId, TimeIn)",
+      false },
+    { "timesheet_entry IsOpen column",
+      "SHOW COLUMNS FROM timesheet_entry LIKE 'IsOpen'",
+      "ALTER TABLE timesheet_entry ADD COLUMN IsOpen TINYINT(1) AS (TimeIn=TimeOut) STORED",
+      false },
+    { "timesheet_entry (IsOpen, TimeIn) index",
+      "SHOW INDEX FROM timesheet_entry WHERE Key_name='open_time_idx'",
+      "ALTER TABLE timesheet_entry ADD INDEX open_time_idx (IsOpen, TimeIn)",
+      true }
+};
+
+static const int CHANGE_COUNT = sizeof(CHANGES) / sizeof(CHANGES[0]);
+
+/**
+ * @brief printSchema list the columns and indexes of table, as MySQL reports them.
+ */
+static bool printSchema(QSqlDatabase &db, const QString &table, QTextStream &out)
+{
+    QSqlQuery q(db);
+    if(!q.exec("SHOW COLUMNS FROM " + table))
+        return false;
+
+    out << table << " columns:\n";
+    while(q.next())
+    {
+        out << "    " << q.value(0).toString() << " " << q.value(1).toString()
+            << (q.value(2).toString() == "YES" ? " null" : "")
+            << (q.value(3).toString().isEmpty() ? QString() : " key " + q.value(3).toString()) << "\n";
+    }
+
+    if(!q.exec("SHOW INDEX FROM " + table))
+        return false;
+
+    // One row per indexed column, in order; gather them back into one line per index.
+    QStringList names;
+    QStringList columns;
+    while(q.next())
+    {
+        QString name = q.value(q.record().indexOf("Key_name")).toString();
+        QString column = q.value(q.record().indexOf("Column_name")).toString();
+        if(names.isEmpty() || names.last() != name)
+        {
+            names.append(name);
+            columns.append(column);
+        }
+        else
+        {
+            columns.last() += ", " + column;
+        }
+    }
+
+    out << table << " indexes:\n";
+    for(int i = 0; i < names.size(); i++)
+    {
+        out << "    " << names[i] << " (" << columns[i] << ")\n";
+    }
+
+    if(names.isEmpty())
+        out << "    none\n";
+
+    return true;
+}
+
+/**
+ * @brief explain one line per table in the plan: how it is read, the key used and the
+ *        rows MySQL expects to examine.
+ */
+static QString explain(QSqlDatabase &db, const QString &sql)
+{
+    QSqlQuery q(db);
+    if(!q.exec("EXPLAIN " + sql))
+        return "EXPLAIN failed: " + q.lastError().text();
+
+    QStringList steps;
+    while(q.next())
+    {
+        QSqlRecord rec = q.record();
+        QString key = q.value(rec.indexOf("key")).toString();
+        steps.append(QString("%1 %2 key=%3 rows=%4")
+                     .arg(q.value(rec.indexOf("table")).toString())
+                     .arg(q.value(rec.indexOf("type")).toString())
+                     .arg(key.isEmpty() ? "none" : key)
+                     .arg(q.value(rec.indexOf("rows")).toString()));
+    }
+
+    return steps.join("; ");
+}
+
+/**
+ * @brief timeQuery the fastest of TIMING_RUNS runs of sql, reading every row, in
+ *        milliseconds.  -1 if it fails.
+ */
+static double timeQuery(QSqlDatabase &db, const QString &sql)
+{
+    qint64 best = -1;
+    for(int i = 0; i < TIMING_RUNS; i++)
+    {
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        QElapsedTimer timer;
+        timer.start();
+        if(!q.exec(sql))
+            return -1;
+
+        while(q.next())
+        {
+        }
+
+        qint64 nanos = timer.nsecsElapsed();
+        if(best < 0 || nanos < best)
+            best = nanos;
+    }
+
+    return best / 1000000.0;
+}
+
+/**
+ * @brief runProbes EXPLAIN and time each hot query in the form Timesheet will use.
+ * @param flag whether IsOpen exists, so the flagged forms are the ones that run.
+ * @param ms filled with the timing of each probe.
+ */
+static void runProbes(QSqlDatabase &db, bool flag, QTextStream &out, double *ms)
+{
+    for(int i = 0; i < PROBE_COUNT; i++)
+    {
+        const Probe &p = PROBES[i];
+        QString sql = flag && p.flagSql[0] != '\0' ? p.flagSql : p.sql;
+        ms[i] = timeQuery(db, sql);
+        out << "    " << QString(p.name).leftJustified(16) << QString::number(ms[i], 'f', 3) << " ms  "
+            << explain(db, sql) << "\n";
+    }
+}
+
+static bool exists(QSqlDatabase &db, const char *check)
+{
+    QSqlQuery q(db);
+    return q.exec(check) && q.next();
+}
+
+int runMigration(const QStringList &args)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    bool dryRun = args.contains("--dry-run");
+
+    if(DbConnection::backend()->isLocal())
+    {
+        out << "The local " << DbConnection::backend()->name() << " database is created with its indexes; nothing to migrate.\n";
+        return 0;
+    }
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+    {
+        err << "Could not connect to the database.\n";
+        return 1;
+    }
+
+    if(!printSchema(db, "user", out) || !printSchema(db, "timesheet_entry", out))
+    {
+        err << "Could not read the schema: " << db.lastError().text() << "\n";
+        return 1;
+    }
+
+    bool flag = exists(db, CHANGES[2].check);
+    double before[PROBE_COUNT];
+    out << "\nBefore:\n";
+    runProbes(db, flag, out, before);
+
+    out << "\n";
+    int failed = 0;
+    int made = 0;
+    for(int i = 0; i < CHANGE_COUNT; i++)
+    {
+        const Change &c = CHANGES[i];
+        if(exists(db, c.check))
+        {
+            out << "ok       " << c.name << "\n";
+            continue;
+        }
+
+        if(c.needsFlag && !flag)
+        {
+            out << "skipped  " << c.name << " (no IsOpen column)\n";
+            continue;
+        }
+
+        if(dryRun)
+        {
+            out << "would    " << c.sql << "\n";
+            continue;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        QSqlQuery q(db);
+        if(!q.exec(c.sql))
+        {
+            // Generated columns need MySQL 5.7 or MariaDB 10.2; without one the open
+            // entry lookup keeps using (userId, TimeIn), which still narrows it to a
+            // user's entries for today.
+            out << "failed   " << c.sql << ": " << q.lastError().text() << "\n";
+            failed++;
+            continue;
+        }
+
+        out << "added    " << c.name << " in " << timer.elapsed() << " ms\n";
+        made++;
+        if(&c == &CHANGES[2])
+            flag = true;
+    }
+
+    if(made == 0)
+    {
+        out << "\nNothing changed.\n";
+        return failed > 0 ? 1 : 0;
+    }
+
+    double after[PROBE_COUNT];
+    out << "\nAfter:\n";
+    runProbes(db, flag, out, after);
+
+    out << "\n";
+    for(int i = 0; i < PROBE_COUNT; i++)
+    {
+        if(before[i] < 0 || after[i] < 0)
+            continue;
+
+        out << "    " << QString(PROBES[i].name).leftJustified(16)
+            << QString::number(before[i], 'f', 3) << " -> " << QString::number(after[i], 'f', 3) << " ms\n";
+    }
+
+    if(flag)
+        out << "\nKiosks use IsOpen once they reconnect or restart.\n";
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+#ifndef MIGRATION_H
+#define MIGRATION_H
+
+#include <QStringList>
+
+/**
+ * @brief runMigration add the indexes the punch path needs to user and timesheet_entry:
+ *        Signin --migrate [--dry-run].  Prints the schema it found, what it changed, and
+ *        an EXPLAIN plus a timing of each hot query before and after.  Safe to run again;
+ *        anything already in place is left alone.  Needs a QCoreApplication and a
+ *        configured DbConnection.
+ */
+int runMigration(const QStringList &args);
+
+#endif // MIGRATION_H
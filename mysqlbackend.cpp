@@ -0,0 +1,73 @@
+#include "mysqlbackend.h"
+#include <QSqlQuery>
+
+/**
+ * @brief MySqlBackend::MySqlBackend
+ * @param host hostname or ip of the server.
+ * @param uname user name, which is also the database name.
+ * @param pwd password for the user.
+ */
+MySqlBackend::MySqlBackend(QString host, QString uname, QString pwd) :
+    host(host),
+    uname(uname),
+    pwd(pwd)
+{
+}
+
+QString MySqlBackend::name() const
+{
+    return "mysql";
+}
+
+bool MySqlBackend::isLocal() const
+{
+    return false;
+}
+
+QSqlDatabase MySqlBackend::addDatabase(const QString &connectionName)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QMYSQL", connectionName);
+    db.setHostName(host);
+    db.setDatabaseName(uname);
+    db.setUserName(uname);
+    db.setPassword(pwd);
+    db.setConnectOptions("MYSQL_OPT_CONNECT_TIMEOUT=5");
+    return db;
+}
+
+bool MySqlBackend::prepare(QSqlDatabase &db)
+{
+    Q_UNUSED(db);
+    return true;
+}
+
+bool MySqlBackend::hasColumn(const QSqlDatabase &db, const QString &table, const QString &column)
+{
+    QSqlQuery q(db);
+    return q.exec(QString("SHOW COLUMNS FROM %1 LIKE '%2'").arg(table).arg(column)) && q.next();
+}
+
+QString MySqlBackend::today() const
+{
+    return "CURDATE()";
+}
+
+QString MySqlBackend::secondsBetween(const QString &from, const QString &to) const
+{
+    return QString("TIMESTAMPDIFF(SECOND, %1, %2)").arg(from).arg(to);
+}
+
+QString MySqlBackend::rowCrc(const QString &columns) const
+{
+    return QString("CRC32(CONCAT_WS('|', %1))").arg(columns);
+}
+
+bool MySqlBackend::joinedUpdates() const
+{
+    return true;
+}
+
+QVariant MySqlBackend::timestamp(const QDateTime &when) const
+{
+    return when;
+}
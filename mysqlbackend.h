@@ -0,0 +1,34 @@
+#ifndef MYSQLBACKEND_H
+#define MYSQLBACKEND_H
+
+#include "storagebackend.h"
+
+/**
+ * @brief The MySqlBackend class keeps the timesheets on the shared MySQL server, named
+ *        after the user as on the original kiosk.  The schema is the server's; --migrate
+ *        adds the indexes.
+ */
+class MySqlBackend : public StorageBackend
+{
+public:
+    MySqlBackend(QString host, QString uname, QString pwd);
+
+    QString name() const;
+    bool isLocal() const;
+    QSqlDatabase addDatabase(const QString &connectionName);
+    bool prepare(QSqlDatabase &db);
+    bool hasColumn(const QSqlDatabase &db, const QString &table, const QString &column);
+
+    QString today() const;
+    QString secondsBetween(const QString &from, const QString &to) const;
+    QString rowCrc(const QString &columns) const;
+    bool joinedUpdates() const;
+    QVariant timestamp(const QDateTime &when) const;
+
+private:
+    QString host;
+    QString uname;
+    QString pwd;
+};
+
+#endif // MYSQLBACKEND_H
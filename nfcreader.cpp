@@ -0,0 +1,37 @@
+#include "nfcreader.h"
+
+/**
+ * @brief NfcUid::toHex
+ * @return the UID as lower case hex, e.g. "04a1b2c3".
+ */
+QString NfcUid::toHex() const
+{
+    return QString::fromLatin1(bytes.toHex());
+}
+
+/**
+ * @brief NfcUid::toRfid the value stored in user.rfid for this card.
+ *        The modified nfc-poll the kiosk used to run printed the UID as an unsigned
+ *        decimal number, most significant byte first, so cards registered with it keep
+ *        working.
+ */
+QString NfcUid::toRfid() const
+{
+    quint64 value = 0;
+    for(int i = 0; i < bytes.size() && i < 8; i++)
+    {
+        value = (value << 8) | (quint8)bytes[i];
+    }
+
+    return QString::number(value);
+}
+
+/**
+ * @brief NfcUid::fromHex parse a UID written as hex, as in fake reader scripts.
+ */
+NfcUid NfcUid::fromHex(const QString &hex)
+{
+    NfcUid uid;
+    uid.bytes = QByteArray::fromHex(hex.trimmed().toLatin1());
+    return uid;
+}
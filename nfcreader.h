@@ -0,0 +1,53 @@
+#ifndef NFCREADER_H
+#define NFCREADER_H
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * @brief A card UID as read from the reader.
+ */
+struct NfcUid
+{
+    QByteArray bytes;
+
+    bool isValid() const { return !bytes.isEmpty(); }
+    bool operator==(const NfcUid &other) const { return bytes == other.bytes; }
+    bool operator!=(const NfcUid &other) const { return bytes != other.bytes; }
+
+    QString toHex() const;
+    QString toRfid() const;
+    static NfcUid fromHex(const QString &hex);
+};
+
+/**
+ * @brief The NfcReader class is the interface the NFC thread reads cards through.
+ *        A reader is opened once and polled in a loop; implementations should keep the
+ *        device open between polls and only reopen it after open() is called again.
+ *        A reader is used from one thread only.
+ */
+class NfcReader
+{
+public:
+    virtual ~NfcReader() {}
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+
+    /**
+     * @brief poll wait up to timeoutMs for a card to be presented.
+     * @param uid filled in when a card is read.
+     * @param timeoutMs how long to wait before giving up.
+     * @return true if a card was read.  On false, check isOpen(): a reader that has
+     *         failed closes itself and needs open() again.
+     */
+    virtual bool poll(NfcUid &uid, int timeoutMs) = 0;
+
+    QString lastError() const { return error; }
+
+protected:
+    QString error;
+};
+
+#endif // NFCREADER_H
@@ -0,0 +1,132 @@
+#include "opensessions.h"
+#include <QReadLocker>
+#include <QWriteLocker>
+
+OpenSessions::OpenSessions() :
+    loaded(false)
+{
+}
+
+/**
+ * @brief OpenSessions::isCurrent same test as "TimeIn>CURDATE()": signed in today.
+ */
+bool OpenSessions::isCurrent(const OpenEntry &entry)
+{
+    return entry.timeIn.date() == QDate::currentDate();
+}
+
+/**
+ * @brief OpenSessions::isLoaded
+ * @return true once the index has been filled from the database.  Until then callers
+ *         should ask the database directly.
+ */
+bool OpenSessions::isLoaded()
+{
+    QReadLocker locker(&lock);
+    return loaded;
+}
+
+/**
+ * @brief OpenSessions::find the user's open entry, if they are signed in.
+ * @return true if the user is signed in.
+ */
+bool OpenSessions::find(int userId, OpenEntry &entry)
+{
+    QReadLocker locker(&lock);
+    QHash<int, OpenEntry>::const_iterator it = byUser.constFind(userId);
+    if(it == byUser.constEnd() || !isCurrent(it.value()))
+        return false;
+
+    entry = it.value();
+    return true;
+}
+
+/**
+ * @brief OpenSessions::entries
+ * @return every open entry, in no particular order.
+ */
+QList<OpenEntry> OpenSessions::entries()
+{
+    QReadLocker locker(&lock);
+    QList<OpenEntry> list;
+    for(QHash<int, OpenEntry>::const_iterator it = byUser.constBegin(); it != byUser.constEnd(); ++it)
+    {
+        if(isCurrent(it.value()))
+            list.append(it.value());
+    }
+
+    return list;
+}
+
+/**
+ * @brief OpenSessions::count
+ * @return number of people signed in.
+ */
+int OpenSessions::count()
+{
+    QReadLocker locker(&lock);
+    int n = 0;
+    for(QHash<int, OpenEntry>::const_iterator it = byUser.constBegin(); it != byUser.constEnd(); ++it)
+    {
+        if(isCurrent(it.value()))
+            n++;
+    }
+
+    return n;
+}
+
+/**
+ * @brief OpenSessions::add record a sign in that has been committed.
+ */
+void OpenSessions::add(const OpenEntry &entry)
+{
+    QWriteLocker locker(&lock);
+    byUser.insert(entry.user.id, entry);
+}
+
+/**
+ * @brief OpenSessions::remove record a sign out that has been committed.
+ */
+void OpenSessions::remove(int userId)
+{
+    QWriteLocker locker(&lock);
+    byUser.remove(userId);
+}
+
+/**
+ * @brief OpenSessions::replaceAll reconcile with the database's list of open entries.
+ * @param entries result of the open entry query.
+ * @return how many users' state differed from the index before the replace.
+ */
+int OpenSessions::replaceAll(const QList<OpenEntry> &entries)
+{
+    QWriteLocker locker(&lock);
+
+    QHash<int, OpenEntry> fresh;
+    for(int i = 0; i < entries.size(); i++)
+    {
+        fresh.insert(entries[i].user.id, entries[i]);
+    }
+
+    int drift = 0;
+    if(loaded)
+    {
+        for(QHash<int, OpenEntry>::const_iterator it = fresh.constBegin(); it != fresh.constEnd(); ++it)
+        {
+            // Entries signed in from this kiosk have id -1 until they are reconciled.
+            QHash<int, OpenEntry>::const_iterator old = byUser.constFind(it.key());
+            if(old == byUser.constEnd() || (old.value().id >= 0 && old.value().id != it.value().id))
+                drift++;
+        }
+
+        for(QHash<int, OpenEntry>::const_iterator it = byUser.constBegin(); it != byUser.constEnd(); ++it)
+        {
+            if(isCurrent(it.value()) && !fresh.contains(it.key()))
+                drift++;
+        }
+    }
+
+    byUser = fresh;
+    loaded = true;
+    return drift;
+}
@@ -0,0 +1,41 @@
+#ifndef OPENSESSIONS_H
+#define OPENSESSIONS_H
+
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+#include "timesheet.h"
+
+/**
+ * @brief The OpenSessions class is the in-memory index of who is signed in right now:
+ *        user id -> the open timesheet_entry (entry id and TimeIn).
+ *
+ *        The punch path updates it as sign ins and sign outs commit, and the DB worker
+ *        periodically replaces it with what the database says so changes made elsewhere
+ *        are picked up.  Like the "TimeIn>CURDATE()" query it replaces, only entries
+ *        from today count as open; yesterday's forgotten sign outs drop out at midnight.
+ *        Safe to use from any thread.
+ */
+class OpenSessions
+{
+public:
+    OpenSessions();
+
+    bool isLoaded();
+    bool find(int userId, OpenEntry &entry);
+    QList<OpenEntry> entries();
+    int count();
+
+    void add(const OpenEntry &entry);
+    void remove(int userId);
+    int replaceAll(const QList<OpenEntry> &entries);
+
+private:
+    static bool isCurrent(const OpenEntry &entry);
+
+    QReadWriteLock lock;
+    bool loaded;
+    QHash<int, OpenEntry> byUser;
+};
+
+#endif // OPENSESSIONS_H
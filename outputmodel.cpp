@@ -0,0 +1,61 @@
+#include "outputmodel.h"
+
+/**
+ * @brief OutputModel::OutputModel
+ * @param maxRows most lines kept; the oldest are dropped beyond this.
+ */
+OutputModel::OutputModel(int maxRows, QObject *parent) :
+    QAbstractListModel(parent),
+    maxRows(maxRows)
+{
+}
+
+int OutputModel::rowCount(const QModelIndex &parent) const
+{
+    if(parent.isValid())
+        return 0;
+
+    return lines.size();
+}
+
+QVariant OutputModel::data(const QModelIndex &index, int role) const
+{
+    if(role != Qt::DisplayRole || !index.isValid() || index.row() >= lines.size())
+        return QVariant();
+
+    return lines[index.row()];
+}
+
+/**
+ * @brief OutputModel::appendLines add lines to the bottom in one update.
+ */
+void OutputModel::appendLines(const QStringList &more)
+{
+    if(more.isEmpty())
+        return;
+
+    // Only the tail of a batch bigger than the whole model would survive.
+    QStringList added = more.size() > maxRows ? more.mid(more.size() - maxRows) : more;
+
+    int overflow = lines.size() + added.size() - maxRows;
+    if(overflow > 0)
+    {
+        beginRemoveRows(QModelIndex(), 0, overflow - 1);
+        lines.erase(lines.begin(), lines.begin() + overflow);
+        endRemoveRows();
+    }
+
+    beginInsertRows(QModelIndex(), lines.size(), lines.size() + added.size() - 1);
+    lines.append(added);
+    endInsertRows();
+}
+
+void OutputModel::clear()
+{
+    if(lines.isEmpty())
+        return;
+
+    beginResetModel();
+    lines.clear();
+    endResetModel();
+}
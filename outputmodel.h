@@ -0,0 +1,32 @@
+#ifndef OUTPUTMODEL_H
+#define OUTPUTMODEL_H
+
+#include <QAbstractListModel>
+#include <QStringList>
+
+/**
+ * @brief The OutputModel class holds the lines shown in the output display, one row
+ *        per line, for a QListView that only lays out and paints the rows on screen.
+ *
+ *        Lines are added a batch at a time so the view updates once per batch, and only
+ *        the newest maxRows lines are kept; older ones are dropped from the top.
+ */
+class OutputModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit OutputModel(int maxRows, QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    void appendLines(const QStringList &more);
+    void clear();
+
+private:
+    int maxRows;
+    QStringList lines;
+};
+
+#endif // OUTPUTMODEL_H
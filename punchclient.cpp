@@ -0,0 +1,266 @@
+#include "punchclient.h"
+#include "metrics.h"
+#include "roster.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QLocalSocket>
+#include <QMutexLocker>
+#include <QTcpSocket>
+#include <QTimer>
+#include <unistd.h>
+
+// A request unanswered this long is reported as failed, or for a punch, as waiting.
+static const int REQUEST_TIMEOUT_MS = 10000;
+// Wait between attempts to reach the daemon.
+static const int RECONNECT_MS = 1000;
+// How often the local roster copy is brought up to date.
+static const int ROSTER_REFRESH_MS = 60000;
+
+/**
+ * @brief isPunch whether the job changes the timesheet, so it must reach the daemon
+ *        exactly once rather than be given up on.
+ */
+static bool isPunch(DbJob::Type type)
+{
+    return type == DbJob::SignIn || type == DbJob::SignOut || type == DbJob::Toggle;
+}
+
+/**
+ * @brief PunchClient::PunchClient
+ * @param address "host:port", or the path of the daemon's Unix socket.
+ * @param roster card lookups cache to keep fresh, or NULL.
+ */
+PunchClient::PunchClient(QString address, Roster *roster, QObject *parent) :
+    JobRunner(parent),
+    address(address),
+    roster(roster),
+    nextSeq(1),
+    scheduled(false),
+    socket(0),
+    isConnected(false),
+    reconnectTimer(0),
+    expireTimer(0),
+    rosterTimer(0)
+{
+    // Unique enough between restarts of the kiosks sharing one daemon.
+    kiosk = ((quint64)QDateTime::currentMSecsSinceEpoch() << 16) ^ (quint64)getpid();
+}
+
+/**
+ * @brief PunchClient::submit queue a job for the daemon.  Safe to call from any thread.
+ */
+void PunchClient::submit(const DbJob &job)
+{
+    QMutexLocker locker(&lock);
+    queue.enqueue(job);
+
+    if(!scheduled)
+    {
+        scheduled = true;
+        QMetaObject::invokeMethod(this, "sendQueued", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief PunchClient::start connect to the daemon.  Runs on the client's thread.
+ */
+void PunchClient::start()
+{
+    int colon = address.lastIndexOf(':');
+    bool isPort = false;
+    if(colon > 0)
+        address.mid(colon + 1).toUShort(&isPort);
+
+    if(isPort && !address.contains('/'))
+    {
+        QTcpSocket *tcp = new QTcpSocket(this);
+        tcp->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(tcp, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(disconnected()));
+        socket = tcp;
+    }
+    else
+    {
+        QLocalSocket *local = new QLocalSocket(this);
+        connect(local, SIGNAL(error(QLocalSocket::LocalSocketError)), this, SLOT(disconnected()));
+        socket = local;
+    }
+
+    connect(socket, SIGNAL(connected()), this, SLOT(connected()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(disconnected()));
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readServer()));
+
+    reconnectTimer = new QTimer(this);
+    reconnectTimer->setSingleShot(true);
+    reconnectTimer->setInterval(RECONNECT_MS);
+    connect(reconnectTimer, SIGNAL(timeout()), this, SLOT(reconnect()));
+
+    expireTimer = new QTimer(this);
+    expireTimer->setInterval(1000);
+    connect(expireTimer, SIGNAL(timeout()), this, SLOT(expireRequests()));
+    expireTimer->start();
+
+    if(roster)
+    {
+        rosterTimer = new QTimer(this);
+        rosterTimer->setInterval(ROSTER_REFRESH_MS);
+        connect(rosterTimer, SIGNAL(timeout()), this, SLOT(refreshRoster()));
+        rosterTimer->start();
+        refreshRoster();
+    }
+
+    reconnect();
+}
+
+void PunchClient::reconnect()
+{
+    if(isConnected || !socket)
+        return;
+
+    QTcpSocket *tcp = qobject_cast<QTcpSocket *>(socket);
+    if(tcp)
+    {
+        int colon = address.lastIndexOf(':');
+        tcp->abort();
+        tcp->connectToHost(address.left(colon), address.mid(colon + 1).toUShort());
+        return;
+    }
+
+    QLocalSocket *local = qobject_cast<QLocalSocket *>(socket);
+    local->abort();
+    local->connectToServer(address);
+}
+
+void PunchClient::connected()
+{
+    isConnected = true;
+    buffer.clear();
+
+    // Anything sent on the old connection may not have arrived; the daemon
+    // recognizes the ones that did.
+    for(QMap<quint32, Outstanding>::const_iterator it = outstanding.constBegin(); it != outstanding.constEnd(); ++it)
+    {
+        send(it.key(), it.value().job);
+    }
+}
+
+void PunchClient::disconnected()
+{
+    if(isConnected)
+        qWarning() << "Lost the punch daemon at" << address;
+
+    isConnected = false;
+    if(reconnectTimer && !reconnectTimer->isActive())
+        reconnectTimer->start();
+}
+
+void PunchClient::sendQueued()
+{
+    QQueue<DbJob> jobs;
+    {
+        QMutexLocker locker(&lock);
+        jobs.swap(queue);
+        scheduled = false;
+    }
+
+    while(!jobs.isEmpty())
+    {
+        Outstanding request;
+        request.job = jobs.dequeue();
+        request.age.start();
+        request.notified = false;
+
+        quint32 seq = nextSeq++;
+        outstanding.insert(seq, request);
+
+        if(isConnected)
+            send(seq, request.job);
+    }
+}
+
+void PunchClient::send(quint32 seq, const DbJob &job)
+{
+    PunchRequest request;
+    request.kiosk = kiosk;
+    request.seq = seq;
+    request.job = job;
+    socket->write(PunchProtocol::frame(PunchProtocol::encodeRequest(request)));
+}
+
+void PunchClient::readServer()
+{
+    buffer.append(socket->readAll());
+
+    QByteArray payload;
+    bool bad = false;
+    while(PunchProtocol::takeFrame(buffer, payload, bad))
+    {
+        PunchResponse response;
+        if(!PunchProtocol::decodeResponse(payload, response))
+        {
+            bad = true;
+            break;
+        }
+
+        // Already reported as timed out, or answered twice after a resend.
+        if(!outstanding.contains(response.seq))
+            continue;
+
+        Outstanding request = outstanding.take(response.seq);
+        response.result.job = request.job;
+        response.result.waited = request.notified;
+        Metrics::record(Metrics::DaemonRoundTrip, request.age.nsecsElapsed());
+        emit finished(response.result);
+    }
+
+    if(bad)
+    {
+        qWarning() << "Bad answer from the punch daemon; reconnecting.";
+        socket->close();
+    }
+}
+
+void PunchClient::expireRequests()
+{
+    QMap<quint32, Outstanding>::iterator it = outstanding.begin();
+    while(it != outstanding.end())
+    {
+        if(it.value().age.elapsed() < REQUEST_TIMEOUT_MS)
+        {
+            ++it;
+            continue;
+        }
+
+        // The daemon may have this punch already, or get it after the next reconnect;
+        // failing it now could tell the user it failed when it is then applied.
+        if(isPunch(it.value().job.type))
+        {
+            if(!it.value().notified)
+            {
+                it.value().notified = true;
+                DbResult result;
+                result.job = it.value().job;
+                result.success = false;
+                result.lines << "The sign in server is not answering.  Your punch will be sent when it is back.";
+                Metrics::count(Metrics::DaemonTimeouts);
+                emit waiting(result);
+            }
+
+            ++it;
+            continue;
+        }
+
+        DbResult result;
+        result.job = it.value().job;
+        result.success = false;
+        result.lines << "Could not reach the sign in server.";
+        Metrics::count(Metrics::DaemonTimeouts);
+        it = outstanding.erase(it);
+        emit finished(result);
+    }
+}
+
+void PunchClient::refreshRoster()
+{
+    if(!roster->refresh())
+        Metrics::count(Metrics::QueryErrors);
+}
@@ -0,0 +1,80 @@
+#ifndef PUNCHCLIENT_H
+#define PUNCHCLIENT_H
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QQueue>
+#include "punchprotocol.h"
+
+class QIODevice;
+class QTimer;
+class Roster;
+
+/**
+ * @brief The PunchClient class sends a kiosk's DbJobs to the punch daemon instead of
+ *        running them against the database itself.  Move it to its own QThread like a
+ *        DbWorker and call start() (queued) once the thread is running.
+ *
+ *        The address is "host:port" for TCP, or the path of the daemon's Unix socket.
+ *        Requests carry this kiosk's id and an increasing sequence number and are kept
+ *        until answered: after a dropped connection they are sent again, and the daemon
+ *        answers a resent punch without punching twice.  A punch (sign in, sign out or
+ *        toggle) is never given up on, since the daemon may still apply it: after
+ *        REQUEST_TIMEOUT_MS the window is told through waiting() that it will be sent
+ *        once the daemon is back, and it is resent until answered.  Any other request
+ *        unanswered for REQUEST_TIMEOUT_MS fails with a message instead.  Punches held
+ *        this way are kept in memory only, not across a restart of the kiosk.
+ *
+ *        If a Roster is given it is refreshed from the database every ROSTER_REFRESH_MS,
+ *        so card swipes are still identified without asking the daemon.
+ */
+class PunchClient : public JobRunner
+{
+    Q_OBJECT
+
+public:
+    explicit PunchClient(QString address, Roster *roster = 0, QObject *parent = 0);
+    void submit(const DbJob &job);
+
+public slots:
+    void start();
+
+private slots:
+    void sendQueued();
+    void connected();
+    void disconnected();
+    void readServer();
+    void reconnect();
+    void expireRequests();
+    void refreshRoster();
+
+private:
+    struct Outstanding
+    {
+        DbJob job;
+        QElapsedTimer age;
+        bool notified;  // waiting() already sent for this punch.
+    };
+
+    void send(quint32 seq, const DbJob &job);
+
+    QString address;
+    Roster *roster;
+    quint64 kiosk;
+    quint32 nextSeq;
+
+    QMutex lock;
+    QQueue<DbJob> queue;
+    bool scheduled;
+
+    QIODevice *socket;
+    bool isConnected;
+    QByteArray buffer;
+    QMap<quint32, Outstanding> outstanding;
+    QTimer *reconnectTimer;
+    QTimer *expireTimer;
+    QTimer *rosterTimer;
+};
+
+#endif // PUNCHCLIENT_H
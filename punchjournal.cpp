@@ -0,0 +1,299 @@
+#include "punchjournal.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <QFileInfo>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Truncate the log once it is fully replayed and at least this big.
+static const qint64 COMPACT_BYTES = 64 * 1024;
+
+/**
+ * @brief syncDirectory fsync the directory holding path, so a rename into it survives
+ *        a crash.
+ */
+static bool syncDirectory(const QString &path)
+{
+    int fd = ::open(QFile::encodeName(QFileInfo(path).absolutePath()).constData(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+/**
+ * @brief PunchJournal::PunchJournal
+ * @param path file the log is kept in.  The last replayed sequence number is kept
+ *        next to it in path + ".done".
+ * @param mode whether every append is fsync'd.
+ */
+PunchJournal::PunchJournal(QString path, SyncMode mode) :
+    path(path),
+    mode(mode),
+    nextSeq(1),
+    replayedSeq(0)
+{
+}
+
+PunchJournal::~PunchJournal()
+{
+    file.close();
+}
+
+/**
+ * @brief PunchJournal::open load the punches that were never replayed and open the log for appending.
+ * @return false if the log file cannot be opened.
+ */
+bool PunchJournal::open()
+{
+    QMutexLocker locker(&lock);
+
+    QFile done(path + ".done");
+    if(done.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        replayedSeq = done.readAll().trimmed().toLongLong();
+        done.close();
+    }
+
+    nextSeq = replayedSeq + 1;
+    queue.clear();
+
+    // End of the last complete line; anything after it is a torn append.  -1 if the
+    // log could not be read, so nothing is cut off.
+    qint64 goodEnd = -1;
+    QFile existing(path);
+    if(existing.open(QIODevice::ReadOnly))
+    {
+        int bad = 0;
+        goodEnd = 0;
+        while(!existing.atEnd())
+        {
+            QByteArray line = existing.readLine();
+            if(line.endsWith('\n'))
+                goodEnd = existing.pos();
+
+            Punch punch;
+            if(!decode(line, punch))
+            {
+                // A torn write from a crash mid-append; it was never acknowledged.
+                bad++;
+                continue;
+            }
+
+            nextSeq = qMax(nextSeq, punch.seq + 1);
+            if(punch.seq > replayedSeq)
+                queue.enqueue(punch);
+        }
+
+        existing.close();
+
+        if(bad > 0)
+            qWarning() << "Punch journal" << path << "skipped" << bad << "damaged lines.";
+    }
+
+    // Unbuffered, so a failed append leaves nothing behind in QFile's buffer to be
+    // written after it has been cut back.
+    file.setFileName(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered))
+    {
+        error = "Could not open punch journal " + path + ": " + file.errorString();
+        return false;
+    }
+
+    // Cut off a torn last line, or the next punch would be appended onto it and the
+    // merged line rejected on the next start.
+    if(goodEnd >= 0 && file.size() > goodEnd)
+    {
+        if(!file.resize(goodEnd) || fsync(file.handle()) != 0)
+        {
+            error = "Could not repair punch journal " + path + ": " + file.errorString();
+            file.close();
+            return false;
+        }
+    }
+
+    if(queue.isEmpty() && file.size() > 0)
+        compact();
+
+    if(!queue.isEmpty())
+        qWarning() << "Punch journal has" << queue.size() << "punches waiting to be written.";
+
+    error.clear();
+    return true;
+}
+
+/**
+ * @brief PunchJournal::append durably record a punch.  Assigns punch.seq.
+ * @return true once the punch is on disk (or handed to the OS, with SyncNone).
+ */
+bool PunchJournal::append(Punch &punch)
+{
+    QMutexLocker locker(&lock);
+    if(!file.isOpen())
+    {
+        error = "Punch journal is not open.";
+        return false;
+    }
+
+    punch.seq = nextSeq;
+    QByteArray line = encode(punch);
+
+    // On any failure the journal is cut back to here, so a partial line is never left
+    // for the next punch to be appended onto, and a line that is not acknowledged
+    // does not stay behind with a seq the next punch will use again.
+    qint64 end = file.size();
+
+    if(file.write(line) != line.size() || !file.flush())
+    {
+        error = "Could not write punch journal: " + file.errorString();
+        rollBack(end);
+        return false;
+    }
+
+    if(mode == SyncEveryPunch && fsync(file.handle()) != 0)
+    {
+        error = "Could not sync punch journal.";
+        rollBack(end);
+        return false;
+    }
+
+    nextSeq++;
+    queue.enqueue(punch);
+    return true;
+}
+
+/**
+ * @brief PunchJournal::pending the oldest punches not yet replayed, in order.
+ * @param max most punches to return.
+ */
+QList<Punch> PunchJournal::pending(int max)
+{
+    QMutexLocker locker(&lock);
+    QList<Punch> list;
+    for(int i = 0; i < queue.size() && i < max; i++)
+    {
+        list.append(queue[i]);
+    }
+
+    return list;
+}
+
+int PunchJournal::pendingCount()
+{
+    QMutexLocker locker(&lock);
+    return queue.size();
+}
+
+/**
+ * @brief PunchJournal::markReplayed retire every punch up to and including seq.
+ *        Call only after the database transaction holding them has committed.
+ */
+void PunchJournal::markReplayed(qint64 seq)
+{
+    QMutexLocker locker(&lock);
+    while(!queue.isEmpty() && queue.head().seq <= seq)
+    {
+        queue.dequeue();
+    }
+
+    replayedSeq = qMax(replayedSeq, seq);
+    if(!writeReplayedSeq(replayedSeq))
+        return;
+
+    if(queue.isEmpty() && file.size() >= COMPACT_BYTES)
+        compact();
+}
+
+QString PunchJournal::lastError()
+{
+    QMutexLocker locker(&lock);
+    return error;
+}
+
+QByteArray PunchJournal::encode(const Punch &punch)
+{
+    QByteArray body = QString("%1 %2 %3 %4")
+            .arg(punch.seq)
+            .arg(punch.kind == Punch::SignIn ? "I" : "O")
+            .arg(punch.userId)
+            .arg(punch.when.toMSecsSinceEpoch())
+            .toLatin1();
+
+    return body + " " + QByteArray::number(qChecksum(body.constData(), body.size())) + "\n";
+}
+
+bool PunchJournal::decode(const QByteArray &line, Punch &punch)
+{
+    QByteArray trimmed = line.trimmed();
+    int crcAt = trimmed.lastIndexOf(' ');
+    if(crcAt < 0 || !line.endsWith('\n'))
+        return false;
+
+    QByteArray body = trimmed.left(crcAt);
+    bool ok = false;
+    quint16 crc = trimmed.mid(crcAt + 1).toUShort(&ok);
+    if(!ok || crc != qChecksum(body.constData(), body.size()))
+        return false;
+
+    QList<QByteArray> fields = body.split(' ');
+    if(fields.size() != 4 || (fields[1] != "I" && fields[1] != "O"))
+        return false;
+
+    punch.seq = fields[0].toLongLong();
+    punch.kind = fields[1] == "I" ? Punch::SignIn : Punch::SignOut;
+    punch.userId = fields[2].toInt();
+    punch.when = QDateTime::fromMSecsSinceEpoch(fields[3].toLongLong());
+    return true;
+}
+
+bool PunchJournal::writeReplayedSeq(qint64 seq)
+{
+    QString donePath = path + ".done";
+    QString tmpPath = donePath + ".tmp";
+
+    QFile tmp(tmpPath);
+    if(!tmp.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        error = "Could not write " + tmpPath;
+        return false;
+    }
+
+    tmp.write(QByteArray::number(seq) + "\n");
+    tmp.flush();
+    fsync(tmp.handle());
+    tmp.close();
+
+    if(::rename(QFile::encodeName(tmpPath).constData(), QFile::encodeName(donePath).constData()) != 0)
+    {
+        error = "Could not replace " + donePath;
+        return false;
+    }
+
+    if(!syncDirectory(donePath))
+    {
+        error = "Could not sync the directory of " + donePath;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief PunchJournal::rollBack cut the log back to end after a failed append.
+ */
+void PunchJournal::rollBack(qint64 end)
+{
+    if(!file.resize(end) || fsync(file.handle()) != 0)
+        qWarning() << "Could not cut punch journal" << path << "back after a failed write.";
+}
+
+void PunchJournal::compact()
+{
+    // Only called with nothing pending, after the replayed seq is on disk, so the
+    // sequence numbering carries on from the .done file.
+    file.resize(0);
+    fsync(file.handle());
+}
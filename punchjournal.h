@@ -0,0 +1,76 @@
+#ifndef PUNCHJOURNAL_H
+#define PUNCHJOURNAL_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+
+/**
+ * @brief A sign in or sign out, stamped with the kiosk's clock when it happened.
+ */
+struct Punch
+{
+    enum Kind
+    {
+        SignIn,
+        SignOut
+    };
+
+    qint64 seq;     // assigned by PunchJournal::append, increasing.
+    Kind kind;
+    int userId;
+    QDateTime when;
+};
+
+/**
+ * @brief The PunchJournal class is a local append-only log of punches that have been
+ *        acknowledged to the user but not yet written to timesheet_entry.
+ *
+ *        Each punch is appended as one checksummed line and, with SyncEveryPunch,
+ *        fsync'd before append() returns, so an acknowledged punch survives a crash or
+ *        power cut.  Punches are handed to the database in order through pending() and
+ *        retired with markReplayed(), which records the last replayed sequence number in
+ *        a small side file.  Once everything has been replayed the log is truncated.
+ *
+ *        Replaying the same punch twice must be harmless; see Timesheet::writePunches.
+ */
+class PunchJournal
+{
+public:
+    enum SyncMode
+    {
+        SyncEveryPunch,   // fsync on every append: nothing acknowledged is ever lost.
+        SyncNone          // leave flushing to the OS: faster, may lose the last few punches on power loss.
+    };
+
+    explicit PunchJournal(QString path, SyncMode mode = SyncEveryPunch);
+    ~PunchJournal();
+
+    bool open();
+    bool append(Punch &punch);
+    QList<Punch> pending(int max);
+    int pendingCount();
+    void markReplayed(qint64 seq);
+    QString lastError();
+
+private:
+    static QByteArray encode(const Punch &punch);
+    static bool decode(const QByteArray &line, Punch &punch);
+    bool writeReplayedSeq(qint64 seq);
+    void rollBack(qint64 end);
+    void compact();
+
+    QMutex lock;
+    QString path;
+    SyncMode mode;
+    QFile file;
+    QQueue<Punch> queue;
+    qint64 nextSeq;
+    qint64 replayedSeq;
+    QString error;
+};
+
+#endif // PUNCHJOURNAL_H
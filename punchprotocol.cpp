@@ -0,0 +1,95 @@
+#include "punchprotocol.h"
+#include <QDataStream>
+
+/**
+ * @brief PunchProtocol::frame prefix a payload with its length.
+ */
+QByteArray PunchProtocol::frame(const QByteArray &payload)
+{
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out << (quint32)payload.size();
+    bytes.append(payload);
+    return bytes;
+}
+
+/**
+ * @brief PunchProtocol::takeFrame take the first complete frame off the front of buffer.
+ * @param payload the frame's payload, if there was a complete frame.
+ * @param bad set when the buffer cannot be the start of a valid frame; drop the
+ *        connection.
+ * @return true if a frame was taken.
+ */
+bool PunchProtocol::takeFrame(QByteArray &buffer, QByteArray &payload, bool &bad)
+{
+    bad = false;
+    if(buffer.size() < 4)
+        return false;
+
+    quint32 length = ((quint32)(quint8)buffer[0] << 24) | ((quint32)(quint8)buffer[1] << 16)
+            | ((quint32)(quint8)buffer[2] << 8) | (quint32)(quint8)buffer[3];
+    if(length > (quint32)MAX_FRAME)
+    {
+        bad = true;
+        return false;
+    }
+
+    if(buffer.size() < 4 + (int)length)
+        return false;
+
+    payload = buffer.mid(4, length);
+    buffer.remove(0, 4 + length);
+    return true;
+}
+
+QByteArray PunchProtocol::encodeRequest(const PunchRequest &request)
+{
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_8);
+    out << VERSION << request.kiosk << request.seq << (quint8)request.job.type
+        << (qint32)request.job.userId << (quint8)request.job.reader;
+    return bytes;
+}
+
+bool PunchProtocol::decodeRequest(const QByteArray &payload, PunchRequest &request)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_4_8);
+
+    quint8 version, type, reader;
+    qint32 userId;
+    in >> version >> request.kiosk >> request.seq >> type >> userId >> reader;
+    if(in.status() != QDataStream::Ok || version != VERSION || type > DbJob::PeriodHours)
+        return false;
+
+    request.job.type = (DbJob::Type)type;
+    request.job.userId = userId;
+    request.job.reader = reader;
+    request.job.serial = 0;
+    return true;
+}
+
+QByteArray PunchProtocol::encodeResponse(const PunchResponse &response)
+{
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_8);
+    out << VERSION << response.seq << (quint8)(response.result.success ? 1 : 0)
+        << response.result.name << response.result.lines;
+    return bytes;
+}
+
+bool PunchProtocol::decodeResponse(const QByteArray &payload, PunchResponse &response)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_4_8);
+
+    quint8 version, success;
+    in >> version >> response.seq >> success >> response.result.name >> response.result.lines;
+    if(in.status() != QDataStream::Ok || version != VERSION)
+        return false;
+
+    response.result.success = success != 0;
+    return true;
+}
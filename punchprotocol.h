@@ -0,0 +1,53 @@
+#ifndef PUNCHPROTOCOL_H
+#define PUNCHPROTOCOL_H
+
+#include <QByteArray>
+#include "dbworker.h"
+
+/**
+ * @brief A DbJob on its way from a kiosk to the punch daemon.
+ *        (kiosk, seq) names the request; a kiosk that resends it after a dropped
+ *        connection gets the first answer again instead of a second punch.
+ */
+struct PunchRequest
+{
+    quint64 kiosk;
+    quint32 seq;
+    DbJob job;
+};
+
+/**
+ * @brief The daemon's answer to PunchRequest seq.  result.job is not sent; the kiosk
+ *        fills it in from its own copy of the request.
+ */
+struct PunchResponse
+{
+    quint32 seq;
+    DbResult result;
+};
+
+/**
+ * @brief The PunchProtocol class encodes the messages between kiosks and the punch
+ *        daemon.
+ *
+ *        Every message is a frame: a 32 bit big-endian payload length, then the payload,
+ *        a QDataStream (Qt 4.8 format) starting with the protocol version.  A request is
+ *        version, kiosk, seq, job type, user id and reader (19 bytes); a response is
+ *        version, seq, success, the name and the display lines.
+ */
+class PunchProtocol
+{
+public:
+    static const quint8 VERSION = 1;
+    static const int MAX_FRAME = 1024 * 1024;
+
+    static QByteArray frame(const QByteArray &payload);
+    static bool takeFrame(QByteArray &buffer, QByteArray &payload, bool &bad);
+
+    static QByteArray encodeRequest(const PunchRequest &request);
+    static bool decodeRequest(const QByteArray &payload, PunchRequest &request);
+    static QByteArray encodeResponse(const PunchResponse &response);
+    static bool decodeResponse(const QByteArray &payload, PunchResponse &response);
+};
+
+#endif // PUNCHPROTOCOL_H
@@ -0,0 +1,208 @@
+#include "punchserver.h"
+#include <QDebug>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+// How many answers are kept for kiosks that resend a request.
+static const int REMEMBERED = 4096;
+
+/**
+ * @brief PunchServer::PunchServer
+ * @param punches worker for punches, status, history and user lookups; owns the journal.
+ * @param reports worker for the 555, 777, 1234 and 1111 reports.
+ */
+PunchServer::PunchServer(JobRunner *punches, JobRunner *reports, QObject *parent) :
+    QObject(parent),
+    punches(punches),
+    reports(reports),
+    tcp(0),
+    local(0),
+    nextSerial(0)
+{
+    connect(punches, SIGNAL(finished(DbResult)), this, SLOT(jobFinished(DbResult)), Qt::QueuedConnection);
+    connect(reports, SIGNAL(finished(DbResult)), this, SLOT(jobFinished(DbResult)), Qt::QueuedConnection);
+}
+
+/**
+ * @brief PunchServer::listenTcp accept kiosks on a TCP port, on every interface.
+ */
+bool PunchServer::listenTcp(quint16 port)
+{
+    tcp = new QTcpServer(this);
+    connect(tcp, SIGNAL(newConnection()), this, SLOT(tcpConnection()));
+    if(tcp->listen(QHostAddress::Any, port))
+        return true;
+
+    error = "Could not listen on port " + QString::number(port) + ": " + tcp->errorString();
+    return false;
+}
+
+/**
+ * @brief PunchServer::listenLocal accept kiosks on the same machine through a Unix socket.
+ *        A socket left behind by a previous run is removed first.
+ */
+bool PunchServer::listenLocal(const QString &path)
+{
+    local = new QLocalServer(this);
+    connect(local, SIGNAL(newConnection()), this, SLOT(localConnection()));
+    QLocalServer::removeServer(path);
+    if(local->listen(path))
+        return true;
+
+    error = "Could not listen on " + path + ": " + local->errorString();
+    return false;
+}
+
+QString PunchServer::lastError() const
+{
+    return error;
+}
+
+void PunchServer::tcpConnection()
+{
+    while(tcp->hasPendingConnections())
+    {
+        QTcpSocket *socket = tcp->nextPendingConnection();
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        addClient(socket);
+    }
+}
+
+void PunchServer::localConnection()
+{
+    while(local->hasPendingConnections())
+    {
+        addClient(local->nextPendingConnection());
+    }
+}
+
+void PunchServer::addClient(QIODevice *client)
+{
+    buffers.insert(client, QByteArray());
+    connect(client, SIGNAL(readyRead()), this, SLOT(readClient()));
+    connect(client, SIGNAL(disconnected()), this, SLOT(clientGone()));
+}
+
+/**
+ * @brief PunchServer::readClient handle every complete request a kiosk has sent.
+ *        A kiosk that sends something that is not a request is disconnected.
+ */
+void PunchServer::readClient()
+{
+    QIODevice *client = qobject_cast<QIODevice *>(sender());
+    if(!client || !buffers.contains(client))
+        return;
+
+    QByteArray &buffer = buffers[client];
+    buffer.append(client->readAll());
+
+    QByteArray payload;
+    bool bad = false;
+    while(PunchProtocol::takeFrame(buffer, payload, bad))
+    {
+        PunchRequest request;
+        if(!PunchProtocol::decodeRequest(payload, request))
+        {
+            bad = true;
+            break;
+        }
+
+        handleRequest(client, request);
+    }
+
+    if(bad)
+    {
+        qWarning() << "Dropping a kiosk that sent a bad request.";
+        client->close();
+    }
+}
+
+void PunchServer::clientGone()
+{
+    QIODevice *client = qobject_cast<QIODevice *>(sender());
+    if(!client)
+        return;
+
+    buffers.remove(client);
+
+    // Jobs it was waiting on still finish and are remembered for when it comes back.
+    for(QHash<RequestKey, QIODevice *>::iterator it = waiting.begin(); it != waiting.end(); ++it)
+    {
+        if(it.value() == client)
+            it.value() = 0;
+    }
+
+    client->deleteLater();
+}
+
+void PunchServer::handleRequest(QIODevice *client, const PunchRequest &request)
+{
+    RequestKey key(request.kiosk, request.seq);
+
+    QHash<RequestKey, QByteArray>::const_iterator done = answered.constFind(key);
+    if(done != answered.constEnd())
+    {
+        send(client, done.value());
+        return;
+    }
+
+    if(waiting.contains(key))
+    {
+        // Resent while the first copy is still running; answer on the new connection.
+        waiting[key] = client;
+        return;
+    }
+
+    DbJob job = request.job;
+    job.serial = nextSerial++;
+    inFlight.insert(job.serial, key);
+    waiting.insert(key, client);
+
+    switch(job.type)
+    {
+    case DbJob::ListUsers:
+    case DbJob::CurrentSignIns:
+    case DbJob::AllStats:
+    case DbJob::PeriodHours:
+        reports->submit(job);
+        break;
+    default:
+        punches->submit(job);
+        break;
+    }
+}
+
+void PunchServer::jobFinished(DbResult result)
+{
+    if(!inFlight.contains(result.job.serial))
+        return;
+
+    RequestKey key = inFlight.take(result.job.serial);
+    QIODevice *client = waiting.take(key);
+
+    PunchResponse response;
+    response.seq = key.second;
+    response.result = result;
+    QByteArray payload = PunchProtocol::encodeResponse(response);
+    remember(key, payload);
+
+    if(client && buffers.contains(client))
+        send(client, payload);
+}
+
+void PunchServer::send(QIODevice *client, const QByteArray &payload)
+{
+    client->write(PunchProtocol::frame(payload));
+}
+
+void PunchServer::remember(const RequestKey &key, const QByteArray &payload)
+{
+    answered.insert(key, payload);
+    answeredOrder.enqueue(key);
+    while(answeredOrder.size() > REMEMBERED)
+    {
+        answered.remove(answeredOrder.dequeue());
+    }
+}
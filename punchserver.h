@@ -0,0 +1,65 @@
+#ifndef PUNCHSERVER_H
+#define PUNCHSERVER_H
+
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QQueue>
+#include "punchprotocol.h"
+
+class QIODevice;
+class QLocalServer;
+class QTcpServer;
+
+/**
+ * @brief The PunchServer class is the network side of the punch daemon.  It accepts
+ *        kiosks over TCP and/or a Unix socket, reads PunchRequests, and hands the jobs to
+ *        two DbWorkers: punches, status and history go to the punch worker in the order
+ *        they arrive, so they are decided against one open session index and group
+ *        committed through one journal; the slow reports go to the report worker so
+ *        they do not hold up punches.
+ *
+ *        Requests are idempotent: the last REMEMBERED answers are kept by (kiosk, seq), and
+ *        a request the kiosk resends after a reconnect is answered from there, or attached
+ *        to the job already running for it, instead of being punched twice.
+ */
+class PunchServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    PunchServer(JobRunner *punches, JobRunner *reports, QObject *parent = 0);
+
+    bool listenTcp(quint16 port);
+    bool listenLocal(const QString &path);
+    QString lastError() const;
+
+private slots:
+    void tcpConnection();
+    void localConnection();
+    void readClient();
+    void clientGone();
+    void jobFinished(DbResult result);
+
+private:
+    typedef QPair<quint64, quint32> RequestKey;
+
+    void addClient(QIODevice *client);
+    void handleRequest(QIODevice *client, const PunchRequest &request);
+    void send(QIODevice *client, const QByteArray &payload);
+    void remember(const RequestKey &key, const QByteArray &payload);
+
+    JobRunner *punches;
+    JobRunner *reports;
+    QTcpServer *tcp;
+    QLocalServer *local;
+    QHash<QIODevice *, QByteArray> buffers;
+    QHash<int, RequestKey> inFlight;            // DbJob::serial -> request.
+    QHash<RequestKey, QIODevice *> waiting;     // request -> connection to answer, or NULL.
+    QHash<RequestKey, QByteArray> answered;
+    QQueue<RequestKey> answeredOrder;
+    int nextSerial;
+    QString error;
+};
+
+#endif // PUNCHSERVER_H
@@ -0,0 +1,183 @@
+#include "readerpool.h"
+#include "metrics.h"
+#include "timesheet.h"
+#include <QElapsedTimer>
+#include <chrono>
+
+// Keep polls short so a keypad login is noticed between them.
+static const int POLL_TIMEOUT_MS = 300;
+static const int REOPEN_DELAY_MS = 5000;
+
+/**
+ * @brief ReaderPool::ReaderPool
+ * @param window where swipes are reported; also tells reader 0 when nobody is logged in.
+ * @param roster shared user table the readers resolve cards with.
+ */
+ReaderPool::ReaderPool(SwipeSink *window, Roster *roster) :
+    window(window),
+    roster(roster),
+    stopping(0)
+{
+}
+
+ReaderPool::~ReaderPool()
+{
+    stop();
+    qDeleteAll(readers);
+}
+
+/**
+ * @brief ReaderPool::addReader add a reader before start().  The pool owns it.
+ *        The first reader added is the kiosk reader.
+ */
+void ReaderPool::addReader(NfcReader *reader)
+{
+    readers.append(reader);
+}
+
+int ReaderPool::size() const
+{
+    return readers.size();
+}
+
+/**
+ * @brief ReaderPool::start start one thread per reader.
+ */
+void ReaderPool::start()
+{
+    for(int i = 0; i < readers.size(); i++)
+    {
+        threads.push_back(std::thread(&ReaderPool::run, this, i));
+    }
+}
+
+/**
+ * @brief ReaderPool::stop ask every reader thread to finish and wait for them.
+ */
+void ReaderPool::stop()
+{
+    if(threads.empty())
+        return;
+
+    stopping.fetchAndStoreOrdered(1);
+    window->stopWaiting();
+
+    for(size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+
+    threads.clear();
+}
+
+bool ReaderPool::sleepUnlessStopping(int ms)
+{
+    for(int slept = 0; slept < ms && !stopping.fetchAndAddRelaxed(0); slept += 100)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    return !stopping.fetchAndAddRelaxed(0);
+}
+
+/**
+ * @brief ReaderPool::run one reader's thread: poll for cards and report who swiped.
+ */
+void ReaderPool::run(int index)
+{
+    NfcReader *reader = readers[index];
+    bool kiosk = index == 0;
+
+    // Card lookups are answered from the shared roster; the database is only
+    // asked about cards the roster has not picked up yet.
+    Timesheet timesheet(roster);
+
+    NfcUid lastUid;
+    QElapsedTimer sinceLastUid;
+    bool reportedReaderError = false;
+
+    while(!stopping.fetchAndAddRelaxed(0))
+    {
+        // If there is a user logged in at the kiosk, sleep until their session ends.
+        if(kiosk)
+        {
+            window->waitWhileLoggedIn();
+            if(stopping.fetchAndAddRelaxed(0))
+                break;
+        }
+
+        // The reader is opened once and stays open; only reopen it after a failure.
+        if(!reader->isOpen() && !reader->open())
+        {
+            Metrics::count(Metrics::ReaderErrors);
+            if(!reportedReaderError)
+            {
+                window->postUiEvent(UiEvent::Error, "Could not open NFC reader: " + reader->lastError(), -1, index);
+                reportedReaderError = true;
+            }
+
+            sleepUnlessStopping(REOPEN_DELAY_MS);
+            continue;
+        }
+
+        reportedReaderError = false;
+
+        // check for an RFID card swipe.
+        NfcUid uid;
+        QElapsedTimer pollTimer;
+        pollTimer.start();
+        if(!reader->poll(uid, POLL_TIMEOUT_MS))
+        {
+            // The reader closes itself when a poll fails outright.
+            if(!reader->isOpen())
+                Metrics::count(Metrics::ReaderErrors);
+            continue; // no card yet.
+        }
+        Metrics::record(Metrics::ReaderPoll, pollTimer.nsecsElapsed());
+
+        // The card is usually still in the field when the reader starts polling again.
+        // Every read of it restarts the clock, so a card left on the reader is only
+        // handled again once it has been away for REPEAT_SWIPE_MS.
+        if(uid == lastUid && sinceLastUid.isValid() && sinceLastUid.elapsed() < REPEAT_SWIPE_MS)
+        {
+            sinceLastUid.restart();
+            continue;
+        }
+
+        lastUid = uid;
+        sinceLastUid.start();
+
+        window->postUiEvent(UiEvent::CardDetected, QString(), -1, index);
+
+        // Look for a user with the RFID corresponding to the swiped card.
+        QString rfid = uid.toRfid();
+        UserInfo user;
+        QElapsedTimer resolveTimer;
+        resolveTimer.start();
+        Timesheet::Result r = timesheet.findUserByRfid(rfid, user);
+        Metrics::record(Metrics::UserResolve, resolveTimer.nsecsElapsed());
+
+        if(r == Timesheet::NoConnection)
+        {	// the database failed to connect....
+            window->postUiEvent(UiEvent::Error, "Could Not Connect to Database", -1, index);
+            continue;
+        }
+
+        if(r == Timesheet::QueryFailed)
+        {
+            window->postUiEvent(UiEvent::Error, "Database error, please swipe again.", -1, index);
+            continue;
+        }
+
+        if(r == Timesheet::NotFound)
+        {
+            window->postUiEvent(UiEvent::UnknownCard, rfid, -1, index);
+            continue;
+        }
+
+        // Log in (or, at another reader, punch) the person who swiped.
+        window->postUiEvent(UiEvent::UserResolved, user.firstName + " " + user.lastName, user.id, index);
+    }
+
+    reader->close();
+}
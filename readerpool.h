@@ -0,0 +1,77 @@
+#ifndef READERPOOL_H
+#define READERPOOL_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <thread>
+#include <vector>
+#include "nfcreader.h"
+#include "uieventqueue.h"
+
+class Roster;
+
+/**
+ * @brief The SwipeSink class is where a ReaderPool reports swipes: the MainWindow on a
+ *        kiosk, or the swipe replay load test.  Called from the reader threads.
+ */
+class SwipeSink
+{
+public:
+    virtual ~SwipeSink() {}
+
+    /**
+     * @brief waitWhileLoggedIn block the kiosk reader's thread while someone is logged in.
+     */
+    virtual void waitWhileLoggedIn() = 0;
+
+    /**
+     * @brief stopWaiting release every thread in waitWhileLoggedIn(), now and from now on.
+     */
+    virtual void stopWaiting() = 0;
+
+    virtual void postUiEvent(UiEvent::Type type, const QString &text = QString(), int userId = -1, int reader = 0) = 0;
+};
+
+/**
+ * @brief The ReaderPool class runs one thread per NFC reader.
+ *
+ *        Reader 0 is the kiosk's own reader: a swipe there logs the person in on the
+ *        screen, and the reader rests while anyone is logged in, as before.  Every other
+ *        reader has no screen of its own and never waits for the keypad; a swipe there
+ *        signs the person in, or out if they are signed in, straight away.  All readers
+ *        hand their swipes to the window through MainWindow::postUiEvent(), and from
+ *        there every punch goes through the one DbWorker queue, in the order the swipes
+ *        were handled.
+ *
+ *        The pool only needs a SwipeSink, so the load test can drive the same threads
+ *        without a window.
+ */
+class ReaderPool
+{
+public:
+    // A card read again at the same reader this soon after it was last read is ignored.
+    static const int REPEAT_SWIPE_MS = 2000;
+
+    ReaderPool(SwipeSink *window, Roster *roster);
+    ~ReaderPool();
+
+    void addReader(NfcReader *reader);
+    int size() const;
+    void start();
+    void stop();
+
+private:
+    void run(int index);
+    bool sleepUnlessStopping(int ms);
+
+    SwipeSink *window;
+    Roster *roster;
+    QList<NfcReader *> readers;
+    std::vector<std::thread> threads;
+    QAtomicInt stopping;
+
+    ReaderPool(const ReaderPool &);
+    ReaderPool &operator=(const ReaderPool &);
+};
+
+#endif // READERPOOL_H
@@ -0,0 +1,263 @@
+#include "rollups.h"
+
+Rollups::Rollups() :
+    loaded(false)
+{
+}
+
+bool Rollups::isLoaded()
+{
+    QReadLocker locker(&lock);
+    return loaded;
+}
+
+/**
+ * @brief Rollups::isStale
+ * @return true if the user's buckets have to be read from the database again.
+ */
+bool Rollups::isStale(int userId)
+{
+    QReadLocker locker(&lock);
+    return stale.contains(userId);
+}
+
+/**
+ * @brief Rollups::addSession add a completed entry to the user's buckets.
+ */
+void Rollups::addSession(int userId, const QDateTime &timeIn, const QDateTime &timeOut)
+{
+    QWriteLocker locker(&lock);
+    if(!loaded || stale.contains(userId))
+        return;
+
+    addLocked(byUser[userId], timeIn, timeOut);
+}
+
+/**
+ * @brief Rollups::setUser replace a user's buckets with ones built from their entries.
+ * @param fresh the entries include every punch; if not, the user stays stale.
+ */
+void Rollups::setUser(int userId, const QList<Session> &sessions, bool fresh)
+{
+    UserRollup rollup;
+    for(int i = 0; i < sessions.size(); i++)
+    {
+        addLocked(rollup, sessions[i].first, sessions[i].second);
+    }
+
+    QWriteLocker locker(&lock);
+    byUser.insert(userId, rollup);
+    if(fresh)
+        stale.remove(userId);
+}
+
+/**
+ * @brief Rollups::invalidate stop trusting a user's buckets until setUser() is called.
+ */
+void Rollups::invalidate(int userId)
+{
+    QWriteLocker locker(&lock);
+    if(loaded)
+        stale.insert(userId);
+}
+
+/**
+ * @brief Rollups::load add a completed entry while building a Rollups for takeAll().
+ */
+void Rollups::load(int userId, const QDateTime &timeIn, const QDateTime &timeOut)
+{
+    QWriteLocker locker(&lock);
+    addLocked(byUser[userId], timeIn, timeOut);
+}
+
+/**
+ * @brief Rollups::takeAll replace every user's buckets with the ones built in built,
+ *        leaving it empty.
+ */
+void Rollups::takeAll(Rollups &built)
+{
+    QHash<int, UserRollup> rebuilt;
+    {
+        QWriteLocker locker(&built.lock);
+        rebuilt.swap(built.byUser);
+    }
+
+    QWriteLocker locker(&lock);
+    byUser.swap(rebuilt);
+    stale.clear();
+    loaded = true;
+}
+
+/**
+ * @brief Rollups::seconds the user's time on the clock from the start of from to the
+ *        end of to.  Whole months and weeks inside the range are read from their
+ *        buckets, and only the days left over at the edges from the day buckets.
+ */
+qint64 Rollups::seconds(int userId, const QDate &from, const QDate &to)
+{
+    QReadLocker locker(&lock);
+    QHash<int, UserRollup>::const_iterator it = byUser.constFind(userId);
+    if(it == byUser.constEnd())
+        return 0;
+
+    const UserRollup &rollup = it.value();
+    qint64 total = 0;
+    QDate day = from;
+    while(day <= to)
+    {
+        if(day.day() == 1 && day.addMonths(1).addDays(-1) <= to)
+        {
+            total += bucketSeconds(rollup.periods[Month], keyOf(Month, day));
+            day = day.addMonths(1);
+        }
+        else if(day.dayOfWeek() == Qt::Monday && day.addDays(6) <= to)
+        {
+            total += bucketSeconds(rollup.periods[Week], keyOf(Week, day));
+            day = day.addDays(7);
+        }
+        else
+        {
+            total += bucketSeconds(rollup.periods[Day], keyOf(Day, day));
+            day = day.addDays(1);
+        }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Rollups::buckets the user's non-empty buckets of one period, for every period
+ *        that includes a day from from to to, as (first day of the period, seconds).
+ */
+QList<QPair<QDate, qint64> > Rollups::buckets(int userId, Period period, const QDate &from, const QDate &to)
+{
+    QList<QPair<QDate, qint64> > list;
+
+    QReadLocker locker(&lock);
+    QHash<int, UserRollup>::const_iterator it = byUser.constFind(userId);
+    if(it == byUser.constEnd())
+        return list;
+
+    const QVector<Bucket> &all = it.value().periods[period];
+    int first = keyOf(period, from);
+    int last = keyOf(period, to);
+    for(int i = 0; i < all.size(); i++)
+    {
+        if(all[i].key > last)
+            break;
+
+        if(all[i].key >= first && all[i].seconds > 0)
+            list.append(qMakePair(dateOf(period, all[i].key), (qint64)all[i].seconds));
+    }
+
+    return list;
+}
+
+/**
+ * @brief Rollups::periodStart the first day of the day, week or month a day is in.
+ */
+QDate Rollups::periodStart(Period period, const QDate &day)
+{
+    return dateOf(period, keyOf(period, day));
+}
+
+int Rollups::keyOf(Period period, const QDate &day)
+{
+    switch(period)
+    {
+    case Week:
+        return (int)(day.toJulianDay() - (day.dayOfWeek() - Qt::Monday));
+    case Month:
+        return day.year() * 12 + day.month() - 1;
+    default:
+        return (int)day.toJulianDay();
+    }
+}
+
+QDate Rollups::dateOf(Period period, int key)
+{
+    if(period == Month)
+        return QDate(key / 12, key % 12 + 1, 1);
+
+    return QDate::fromJulianDay(key);
+}
+
+/**
+ * @brief Rollups::addLocked add an entry to the buckets, split at each midnight it
+ *        runs past.
+ */
+void Rollups::addLocked(UserRollup &rollup, const QDateTime &timeIn, const QDateTime &timeOut)
+{
+    QDateTime start = timeIn;
+    while(start < timeOut)
+    {
+        QDateTime midnight(start.date().addDays(1));
+        QDateTime end = midnight < timeOut ? midnight : timeOut;
+        qint32 seconds = start.secsTo(end);
+        QDate day = start.date();
+
+        for(int p = 0; p < PeriodCount; p++)
+        {
+            addBucket(rollup.periods[p], keyOf((Period)p, day), seconds);
+        }
+
+        start = end;
+    }
+}
+
+void Rollups::addBucket(QVector<Bucket> &buckets, int key, qint32 seconds)
+{
+    // Punches nearly always land in the newest bucket.
+    if(buckets.isEmpty() || buckets.last().key < key)
+    {
+        Bucket b;
+        b.key = key;
+        b.seconds = seconds;
+        buckets.append(b);
+        return;
+    }
+
+    if(buckets.last().key == key)
+    {
+        buckets.last().seconds += seconds;
+        return;
+    }
+
+    int lo = 0;
+    int hi = buckets.size();
+    while(lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if(buckets[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if(buckets[lo].key == key)
+    {
+        buckets[lo].seconds += seconds;
+        return;
+    }
+
+    Bucket b;
+    b.key = key;
+    b.seconds = seconds;
+    buckets.insert(lo, b);
+}
+
+qint64 Rollups::bucketSeconds(const QVector<Bucket> &buckets, int key)
+{
+    int lo = 0;
+    int hi = buckets.size();
+    while(lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if(buckets[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < buckets.size() && buckets[lo].key == key ? buckets[lo].seconds : 0;
+}
@@ -0,0 +1,78 @@
+#ifndef ROLLUPS_H
+#define ROLLUPS_H
+
+#include <QDate>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QVector>
+
+/**
+ * @brief The Rollups class keeps each user's time on the clock per day, per ISO week
+ *        (starting Monday) and per month, so hours over any range of days add up a
+ *        handful of buckets instead of reading every entry.
+ *
+ *        Only completed entries count.  An entry that runs past midnight is split at
+ *        midnight, each part going to the day, week and month it fell in.  Like
+ *        UserTotals it is filled once by Timesheet::rebuildRollups(), which load()s the
+ *        entries into a new Rollups and takes them over with takeAll(), and then kept up
+ *        by the punch path: every sign out adds its entry, and a user whose sign out could
+ *        not be checked is marked stale and read from the database again.  Safe to use
+ *        from any thread.
+ */
+class Rollups
+{
+public:
+    enum Period
+    {
+        Day,
+        Week,
+        Month,
+        PeriodCount
+    };
+
+    typedef QPair<QDateTime, QDateTime> Session;
+
+    Rollups();
+
+    bool isLoaded();
+    bool isStale(int userId);
+    void addSession(int userId, const QDateTime &timeIn, const QDateTime &timeOut);
+    void setUser(int userId, const QList<Session> &sessions, bool fresh);
+    void invalidate(int userId);
+    void load(int userId, const QDateTime &timeIn, const QDateTime &timeOut);
+    void takeAll(Rollups &built);
+
+    qint64 seconds(int userId, const QDate &from, const QDate &to);
+    QList<QPair<QDate, qint64> > buckets(int userId, Period period, const QDate &from, const QDate &to);
+
+    static QDate periodStart(Period period, const QDate &day);
+
+private:
+    struct Bucket
+    {
+        qint32 key;
+        qint32 seconds;
+    };
+
+    struct UserRollup
+    {
+        QVector<Bucket> periods[PeriodCount];
+    };
+
+    static int keyOf(Period period, const QDate &day);
+    static QDate dateOf(Period period, int key);
+    static void addLocked(UserRollup &rollup, const QDateTime &timeIn, const QDateTime &timeOut);
+    static void addBucket(QVector<Bucket> &buckets, int key, qint32 seconds);
+    static qint64 bucketSeconds(const QVector<Bucket> &buckets, int key);
+
+    QReadWriteLock lock;
+    bool loaded;
+    QHash<int, UserRollup> byUser;
+    QSet<int> stale;
+};
+
+#endif // ROLLUPS_H
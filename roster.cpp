@@ -0,0 +1,317 @@
+#include "roster.h"
+#include "dbconnection.h"
+#include <QtSql/QtSql>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <algorithm>
+#include <climits>
+
+// One row summarizing the whole table.  If it matches the cached copy nothing changed.
+// %1 is the storage backend's row CRC of ROW_COLUMNS.
+static const char *FINGERPRINT_SQL = "SELECT COUNT(*), COALESCE(SUM(%1), 0) FROM user";
+static const char *ROWS_AFTER_SQL = "SELECT id, FirstName, LastName, rfid, %1 FROM user WHERE id > ?";
+static const char *ROW_COLUMNS = "id, FirstName, LastName, rfid";
+
+/**
+ * @brief rowCrc the CRC32 of the row's values joined with '|', NULLs skipped, as MySQL's
+ *        CRC32(CONCAT_WS(...)) computes it, for backends that have no CRC32.
+ */
+static quint32 rowCrc(const QSqlQuery &q)
+{
+    QStringList values;
+    for(int i = 0; i < 4; i++)
+    {
+        if(!q.value(i).isNull())
+            values.append(q.value(i).toString());
+    }
+
+    QByteArray bytes = values.join("|").toUtf8();
+    quint32 crc = 0xFFFFFFFF;
+    for(int i = 0; i < bytes.size(); i++)
+    {
+        crc ^= (quint8)bytes[i];
+        for(int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief byLastName sort order for the 1111 listing, matching ORDER BY LastName.
+ */
+static bool byLastName(const UserInfo &a, const UserInfo &b)
+{
+    int c = QString::compare(a.lastName, b.lastName, Qt::CaseInsensitive);
+    if(c != 0)
+        return c < 0;
+
+    c = QString::compare(a.firstName, b.firstName, Qt::CaseInsensitive);
+    if(c != 0)
+        return c < 0;
+
+    return a.id < b.id;
+}
+
+Roster::Roster() :
+    loaded(false),
+    maxId(INT_MIN),
+    crcSum(0)
+{
+}
+
+/**
+ * @brief Roster::isLoaded
+ * @return true once the user table has been loaded at least once.
+ */
+bool Roster::isLoaded()
+{
+    QReadLocker locker(&lock);
+    return loaded;
+}
+
+/**
+ * @brief Roster::findById look up a user by user.id without touching the database.
+ * @return true if the user is in the cache.
+ */
+bool Roster::findById(int id, UserInfo &user)
+{
+    QReadLocker locker(&lock);
+    QHash<int, Entry>::const_iterator it = byId.constFind(id);
+    if(it == byId.constEnd())
+        return false;
+
+    user = it.value().user;
+    return true;
+}
+
+/**
+ * @brief Roster::findByRfid look up the owner of a card without touching the database.
+ * @return true if a cached user has this card.
+ */
+bool Roster::findByRfid(const QString &rfid, UserInfo &user)
+{
+    QReadLocker locker(&lock);
+    QHash<QString, int>::const_iterator it = byRfid.constFind(rfid);
+    if(it == byRfid.constEnd())
+        return false;
+
+    user = byId.value(it.value()).user;
+    return true;
+}
+
+/**
+ * @brief Roster::users
+ * @return every cached user, sorted by last name.
+ */
+QList<UserInfo> Roster::users()
+{
+    QReadLocker locker(&lock);
+    return sorted;
+}
+
+int Roster::size()
+{
+    QReadLocker locker(&lock);
+    return byId.size();
+}
+
+/**
+ * @brief Roster::refresh bring the cache up to date with the user table.
+ *        Costs one single-row query when nothing has changed.
+ * @return false if the database could not be reached.
+ */
+bool Roster::refresh()
+{
+    if(!isLoaded())
+        return reload();
+
+    int count;
+    qint64 sum;
+    if(!fetchFingerprint(count, sum))
+        return false;
+
+    int after;
+    {
+        QReadLocker locker(&lock);
+        if(count == byId.size() && sum == crcSum)
+            return true;
+        after = maxId;
+    }
+
+    // Most changes are new users being added; try pulling just those first.
+    QList<Entry> added;
+    if(!fetchRows(after, added))
+        return false;
+
+    merge(added);
+
+    {
+        QReadLocker locker(&lock);
+        if(count == byId.size() && sum == crcSum)
+            return true;
+    }
+
+    // Something was edited or removed.  The table is small, so start over.
+    return reload();
+}
+
+/**
+ * @brief Roster::reload replace the cache with a full copy of the user table.
+ * @return false if the database could not be reached.
+ */
+bool Roster::reload()
+{
+    QList<Entry> rows;
+    if(!fetchRows(INT_MIN, rows))
+        return false;
+
+    replaceAll(rows);
+    return true;
+}
+
+/**
+ * @brief Roster::entries every cached row, for writing a Snapshot.
+ */
+QList<Roster::Entry> Roster::entries()
+{
+    QReadLocker locker(&lock);
+    return byId.values();
+}
+
+/**
+ * @brief Roster::restore fill the cache from a Snapshot instead of the database.
+ *        The next refresh() compares it with the table like any other copy.
+ */
+void Roster::restore(const QList<Entry> &rows)
+{
+    replaceAll(rows);
+}
+
+bool Roster::fetchFingerprint(int &count, qint64 &sum)
+{
+    QString crc = DbConnection::backend()->rowCrc(ROW_COLUMNS);
+    if(crc.isEmpty())
+    {
+        // Reading every row of a local table is cheaper than a round trip anyway.
+        QList<Entry> rows;
+        if(!fetchRows(INT_MIN, rows))
+            return false;
+
+        count = rows.size();
+        sum = 0;
+        for(int i = 0; i < rows.size(); i++)
+        {
+            sum += rows[i].crc;
+        }
+
+        return true;
+    }
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return false;
+
+    QSqlQuery q = DbConnection::prepared(db, QString(FINGERPRINT_SQL).arg(crc));
+    if(!q.exec() || !q.next())
+    {
+        DbConnection::reportError(db);
+        return false;
+    }
+
+    count = q.value(0).toInt();
+    sum = q.value(1).toLongLong();
+    q.finish();
+    return true;
+}
+
+bool Roster::fetchRows(int afterId, QList<Entry> &rows)
+{
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return false;
+
+    QString crc = DbConnection::backend()->rowCrc(ROW_COLUMNS);
+    QSqlQuery q = DbConnection::prepared(db, QString(ROWS_AFTER_SQL).arg(crc.isEmpty() ? QString("NULL") : crc));
+    q.bindValue(0, afterId);
+    if(!q.exec())
+    {
+        DbConnection::reportError(db);
+        return false;
+    }
+
+    while(q.next())
+    {
+        Entry e;
+        e.user.id = q.value(0).toInt();
+        e.user.firstName = q.value(1).toString();
+        e.user.lastName = q.value(2).toString();
+        e.rfid = q.value(3).toString().trimmed();
+        e.crc = crc.isEmpty() ? rowCrc(q) : q.value(4).toUInt();
+        rows.append(e);
+    }
+
+    return true;
+}
+
+void Roster::replaceAll(const QList<Entry> &rows)
+{
+    QWriteLocker locker(&lock);
+    byId.clear();
+    byRfid.clear();
+    maxId = INT_MIN;
+    crcSum = 0;
+    loaded = true;
+
+    for(int i = 0; i < rows.size(); i++)
+    {
+        const Entry &e = rows[i];
+        byId.insert(e.user.id, e);
+        if(!e.rfid.isEmpty())
+            byRfid.insert(e.rfid, e.user.id);
+        crcSum += e.crc;
+        maxId = qMax(maxId, e.user.id);
+    }
+
+    rebuildSortedLocked();
+}
+
+void Roster::merge(const QList<Entry> &rows)
+{
+    if(rows.isEmpty())
+        return;
+
+    QWriteLocker locker(&lock);
+    for(int i = 0; i < rows.size(); i++)
+    {
+        const Entry &e = rows[i];
+        QHash<int, Entry>::iterator old = byId.find(e.user.id);
+        if(old != byId.end())
+        {
+            crcSum -= old.value().crc;
+            byRfid.remove(old.value().rfid);
+        }
+
+        byId.insert(e.user.id, e);
+        if(!e.rfid.isEmpty())
+            byRfid.insert(e.rfid, e.user.id);
+        crcSum += e.crc;
+        maxId = qMax(maxId, e.user.id);
+    }
+
+    rebuildSortedLocked();
+}
+
+void Roster::rebuildSortedLocked()
+{
+    sorted.clear();
+    sorted.reserve(byId.size());
+    for(QHash<int, Entry>::const_iterator it = byId.constBegin(); it != byId.constEnd(); ++it)
+    {
+        sorted.append(it.value().user);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), byLastName);
+}
@@ -0,0 +1,63 @@
+#ifndef ROSTER_H
+#define ROSTER_H
+
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+#include <QString>
+#include "timesheet.h"
+
+/**
+ * @brief The Roster class keeps the user table in memory so identifying a user from a
+ *        card swipe or keypad id does not need a database round trip.
+ *
+ *        Lookups are safe from any thread.  refresh() runs on the calling thread's
+ *        DbConnection and is cheap when nothing has changed: it compares a one-row
+ *        fingerprint (row count and summed row CRCs) with the cached copy, pulls only
+ *        rows with a higher id when users were added, and falls back to a full reload
+ *        when rows were edited or removed.
+ */
+class Roster
+{
+public:
+    /**
+     * @brief One user row, with the rfid and the row CRC the fingerprint sums.
+     */
+    struct Entry
+    {
+        UserInfo user;
+        QString rfid;
+        quint32 crc;
+    };
+
+    Roster();
+
+    bool isLoaded();
+    bool findById(int id, UserInfo &user);
+    bool findByRfid(const QString &rfid, UserInfo &user);
+    QList<UserInfo> users();
+    int size();
+
+    bool refresh();
+    bool reload();
+
+    QList<Entry> entries();
+    void restore(const QList<Entry> &rows);
+
+private:
+    bool fetchFingerprint(int &count, qint64 &sum);
+    bool fetchRows(int afterId, QList<Entry> &rows);
+    void replaceAll(const QList<Entry> &rows);
+    void merge(const QList<Entry> &rows);
+    void rebuildSortedLocked();
+
+    QReadWriteLock lock;
+    bool loaded;
+    int maxId;
+    qint64 crcSum;
+    QHash<int, Entry> byId;
+    QHash<QString, int> byRfid;
+    QList<UserInfo> sorted;
+};
+
+#endif // ROSTER_H
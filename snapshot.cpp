@@ -0,0 +1,222 @@
+#include "snapshot.h"
+#include "roster.h"
+#include "opensessions.h"
+#include "punchjournal.h"
+#include <QDataStream>
+#include <QFile>
+#include <QMutexLocker>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <unistd.h>
+
+// Saved in id order so an unchanged cache saves the same bytes.
+static bool entryBefore(const Roster::Entry &a, const Roster::Entry &b)
+{
+    return a.user.id < b.user.id;
+}
+
+static bool openBefore(const OpenEntry &a, const OpenEntry &b)
+{
+    return a.user.id < b.user.id;
+}
+
+/**
+ * @brief Snapshot::Snapshot
+ * @param path file the snapshot is kept in; path + ".tmp" is used while saving.
+ */
+Snapshot::Snapshot(QString path) :
+    path(path)
+{
+}
+
+QString Snapshot::lastError()
+{
+    QMutexLocker locker(&lock);
+    return error;
+}
+
+/**
+ * @brief Snapshot::load fill the roster and open sessions from the file.
+ * @param journal punches not yet written to the database are applied to the open
+ *        sessions; may be NULL.
+ * @return false if there is no usable snapshot; the caches are left alone.
+ */
+bool Snapshot::load(Roster *roster, OpenSessions *sessions, PunchJournal *journal)
+{
+    QMutexLocker locker(&lock);
+
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        error = "No snapshot at " + path;
+        return false;
+    }
+
+    qint64 size = file.size();
+    uchar *mapped = size > 2 ? file.map(0, size) : NULL;
+    if(!mapped)
+    {
+        error = "Could not map snapshot " + path;
+        return false;
+    }
+
+    // Read straight out of the mapping; nothing is copied until the caches are filled.
+    QByteArray bytes = QByteArray::fromRawData((const char *)mapped, (int)size);
+    quint16 crc = ((quint16)mapped[size - 2] << 8) | mapped[size - 1];
+    if(crc != qChecksum(bytes.constData(), bytes.size() - 2))
+    {
+        file.unmap(mapped);
+        error = "Snapshot " + path + " is damaged.";
+        return false;
+    }
+
+    QDataStream in(bytes);
+    in.setVersion(QDataStream::Qt_4_8);
+
+    quint32 magic, version;
+    qint64 saved;
+    in >> magic >> version >> saved;
+    if(magic != MAGIC || version != VERSION)
+    {
+        file.unmap(mapped);
+        error = "Snapshot " + path + " is from another version.";
+        return false;
+    }
+
+    quint32 count;
+    in >> count;
+    QList<Roster::Entry> rows;
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++)
+    {
+        Roster::Entry e;
+        qint32 id;
+        in >> id >> e.user.firstName >> e.user.lastName >> e.rfid >> e.crc;
+        e.user.id = id;
+        rows.append(e);
+    }
+
+    in >> count;
+    QList<OpenEntry> open;
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++)
+    {
+        OpenEntry entry;
+        qint32 id, userId;
+        qint64 timeIn;
+        in >> id >> userId >> timeIn;
+        entry.id = id;
+        entry.user.id = userId;
+        entry.timeIn = QDateTime::fromMSecsSinceEpoch(timeIn);
+        open.append(entry);
+    }
+
+    bool ok = in.status() == QDataStream::Ok;
+    file.unmap(mapped);
+    if(!ok)
+    {
+        error = "Snapshot " + path + " is truncated.";
+        return false;
+    }
+
+    roster->restore(rows);
+    for(int i = 0; i < open.size(); i++)
+    {
+        roster->findById(open[i].user.id, open[i].user);
+    }
+    sessions->replaceAll(open);
+
+    if(journal)
+    {
+        QList<Punch> pending = journal->pending(INT_MAX);
+        for(int i = 0; i < pending.size(); i++)
+        {
+            if(pending[i].kind == Punch::SignOut)
+            {
+                sessions->remove(pending[i].userId);
+                continue;
+            }
+
+            OpenEntry entry;
+            entry.id = -1;
+            entry.user.id = pending[i].userId;
+            entry.timeIn = pending[i].when;
+            roster->findById(entry.user.id, entry.user);
+            sessions->add(entry);
+        }
+    }
+
+    error.clear();
+    return true;
+}
+
+/**
+ * @brief Snapshot::save write the caches to the file, if they have changed since the
+ *        last save.  Call from the thread that refreshes them.
+ * @return false if the caches are not loaded or the file could not be written.
+ */
+bool Snapshot::save(Roster *roster, OpenSessions *sessions)
+{
+    if(!roster->isLoaded() || !sessions->isLoaded())
+        return false;
+
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_8);
+
+    // The save time is left out of the comparison below, so it is written last.
+    QList<Roster::Entry> rows = roster->entries();
+    std::sort(rows.begin(), rows.end(), entryBefore);
+    out << MAGIC << VERSION << (qint64)0 << (quint32)rows.size();
+    for(int i = 0; i < rows.size(); i++)
+    {
+        const Roster::Entry &e = rows[i];
+        out << (qint32)e.user.id << e.user.firstName << e.user.lastName << e.rfid << e.crc;
+    }
+
+    QList<OpenEntry> open = sessions->entries();
+    std::sort(open.begin(), open.end(), openBefore);
+    out << (quint32)open.size();
+    for(int i = 0; i < open.size(); i++)
+    {
+        out << (qint32)open[i].id << (qint32)open[i].user.id << open[i].timeIn.toMSecsSinceEpoch();
+    }
+
+    QMutexLocker locker(&lock);
+    if(bytes == lastSaved)
+        return true;
+    lastSaved = bytes;
+
+    // Big-endian, as QDataStream wrote the placeholder.
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for(int i = 0; i < 8; i++)
+    {
+        bytes[8 + i] = (char)(now >> (56 - 8 * i));
+    }
+
+    quint16 crc = qChecksum(bytes.constData(), bytes.size());
+    bytes.append((char)(crc >> 8));
+    bytes.append((char)(crc & 0xff));
+
+    QString tmpPath = path + ".tmp";
+    QFile tmp(tmpPath);
+    if(!tmp.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        error = "Could not write " + tmpPath;
+        lastSaved.clear();
+        return false;
+    }
+
+    tmp.write(bytes);
+    tmp.flush();
+    fsync(tmp.handle());
+    tmp.close();
+
+    if(::rename(QFile::encodeName(tmpPath).constData(), QFile::encodeName(path).constData()) != 0)
+    {
+        error = "Could not replace " + path;
+        lastSaved.clear();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+class Roster;
+class OpenSessions;
+class PunchJournal;
+
+/**
+ * @brief The Snapshot class keeps a copy of the roster (with the rfid index) and the open
+ *        session index in a small binary file, so a kiosk that starts while MySQL is slow
+ *        or down can identify cards and decide sign ins from the moment it is up.
+ *
+ *        save() is called after the caches are refreshed and after punches are written;
+ *        it replaces the file atomically and skips the write when nothing changed.
+ *        load() maps the file and fills the caches from it, then replays the journal's
+ *        pending punches on the open sessions, since those came after the last save.
+ *        The DbWorker reconciles both with the database as soon as it can.
+ *
+ *        The file is a QDataStream (Qt 4.8 format): magic, version, save time, the
+ *        roster rows, the open entries, and a CRC-16 of everything before it.
+ */
+class Snapshot
+{
+public:
+    explicit Snapshot(QString path);
+
+    bool load(Roster *roster, OpenSessions *sessions, PunchJournal *journal);
+    bool save(Roster *roster, OpenSessions *sessions);
+    QString lastError();
+
+private:
+    static const quint32 MAGIC = 0x53474e53;    // "SGNS"
+    static const quint32 VERSION = 1;
+
+    QMutex lock;
+    QString path;
+    QByteArray lastSaved;
+    QString error;
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,121 @@
+#include "sqlitebackend.h"
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QDebug>
+
+// Wait this long for another connection's write to finish instead of failing at once.
+static const int BUSY_TIMEOUT_MS = 5000;
+
+// Run on every new connection.  The page cache is per connection, in KiB when negative.
+static const char *SESSION_SQL[] = {
+    "PRAGMA journal_mode=WAL",
+    "PRAGMA synchronous=NORMAL",
+    "PRAGMA temp_store=MEMORY",
+    "PRAGMA cache_size=-4096"
+};
+
+// The same tables as on the server, with the indexes the punch path and reports use.
+static const char *SCHEMA_SQL[] = {
+    "CREATE TABLE IF NOT EXISTS user (id INTEGER PRIMARY KEY, FirstName TEXT, LastName TEXT, rfid TEXT)",
+    "CREATE TABLE IF NOT EXISTS timesheet_entry (id INTEGER PRIMARY KEY, userId INTEGER NOT NULL, TimeIn DATETIME, TimeOut DATETIME)",
+    "CREATE INDEX IF NOT EXISTS rfid_idx ON user (rfid)",
+    "CREATE INDEX IF NOT EXISTS user_time_idx ON timesheet_entry (userId, TimeIn)",
+    "CREATE INDEX IF NOT EXISTS time_in_idx ON timesheet_entry (TimeIn)"
+};
+
+/**
+ * @brief SqliteBackend::SqliteBackend
+ * @param path database file; created if it does not exist.
+ */
+SqliteBackend::SqliteBackend(QString path) :
+    path(path),
+    schemaReady(0)
+{
+}
+
+QString SqliteBackend::name() const
+{
+    return "sqlite";
+}
+
+bool SqliteBackend::isLocal() const
+{
+    return true;
+}
+
+QSqlDatabase SqliteBackend::addDatabase(const QString &connectionName)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(path);
+    db.setConnectOptions(QString("QSQLITE_BUSY_TIMEOUT=%1").arg(BUSY_TIMEOUT_MS));
+    return db;
+}
+
+bool SqliteBackend::prepare(QSqlDatabase &db)
+{
+    QSqlQuery q(db);
+    for(size_t i = 0; i < sizeof(SESSION_SQL) / sizeof(SESSION_SQL[0]); i++)
+    {
+        if(!q.exec(SESSION_SQL[i]))
+        {
+            qWarning() << "Could not set up" << path << ":" << q.lastError().text();
+            return false;
+        }
+    }
+
+    if(schemaReady.fetchAndAddRelaxed(0))
+        return true;
+
+    for(size_t i = 0; i < sizeof(SCHEMA_SQL) / sizeof(SCHEMA_SQL[0]); i++)
+    {
+        if(!q.exec(SCHEMA_SQL[i]))
+        {
+            qWarning() << "Could not create the tables in" << path << ":" << q.lastError().text();
+            return false;
+        }
+    }
+
+    schemaReady.fetchAndStoreRelaxed(1);
+    return true;
+}
+
+bool SqliteBackend::hasColumn(const QSqlDatabase &db, const QString &table, const QString &column)
+{
+    QSqlQuery q(db);
+    if(!q.exec(QString("PRAGMA table_info(%1)").arg(table)))
+        return false;
+
+    while(q.next())
+    {
+        if(q.value(1).toString().compare(column, Qt::CaseInsensitive) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+QString SqliteBackend::today() const
+{
+    return "date('now', 'localtime')";
+}
+
+QString SqliteBackend::secondsBetween(const QString &from, const QString &to) const
+{
+    return QString("(strftime('%s', %2) - strftime('%s', %1))").arg(from).arg(to);
+}
+
+QString SqliteBackend::rowCrc(const QString &columns) const
+{
+    Q_UNUSED(columns);
+    return QString();
+}
+
+bool SqliteBackend::joinedUpdates() const
+{
+    return false;
+}
+
+QVariant SqliteBackend::timestamp(const QDateTime &when) const
+{
+    return when.toString("yyyy-MM-dd hh:mm:ss");
+}
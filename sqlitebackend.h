@@ -0,0 +1,39 @@
+#ifndef SQLITEBACKEND_H
+#define SQLITEBACKEND_H
+
+#include <QAtomicInt>
+#include "storagebackend.h"
+
+/**
+ * @brief The SqliteBackend class keeps the timesheets in an SQLite file on the kiosk, so
+ *        a punch is written without a network round trip and nothing needs a server.
+ *
+ *        The file and its tables and indexes are created the first time it is opened.
+ *        It runs in WAL mode with synchronous=NORMAL: readers never wait for the writer,
+ *        and a commit is an append to the WAL with no fsync; the punch journal is what
+ *        makes an acknowledged punch durable.  Times are stored as "yyyy-MM-dd hh:mm:ss"
+ *        text, which sorts in time order and is what SQLite's date functions expect.
+ */
+class SqliteBackend : public StorageBackend
+{
+public:
+    explicit SqliteBackend(QString path);
+
+    QString name() const;
+    bool isLocal() const;
+    QSqlDatabase addDatabase(const QString &connectionName);
+    bool prepare(QSqlDatabase &db);
+    bool hasColumn(const QSqlDatabase &db, const QString &table, const QString &column);
+
+    QString today() const;
+    QString secondsBetween(const QString &from, const QString &to) const;
+    QString rowCrc(const QString &columns) const;
+    bool joinedUpdates() const;
+    QVariant timestamp(const QDateTime &when) const;
+
+private:
+    QString path;
+    QAtomicInt schemaReady;
+};
+
+#endif // SQLITEBACKEND_H
@@ -0,0 +1,336 @@
+#include "stallwatchdog.h"
+#include "metrics.h"
+#include <QAtomicPointer>
+#include <QDebug>
+#include <QFile>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+// How often the GUI thread ticks, and the watcher thread looks at the ticks.
+static const int TICK_MS = 50;
+static const int WATCH_MS = 20;
+// A stall still going after this long is logged before it ends, in case it never does.
+static const int HANG_LOG_MS = 10000;
+// Stalls kept for report(), and how many of them it shows.
+static const int RECENT_MAX = 20;
+static const int REPORT_RECENT = 5;
+static const int REPORT_CAUSES = 8;
+// The log is rotated to .1, .2, ... once it is this big.
+static const qint64 LOG_MAX_BYTES = 256 * 1024;
+static const int LOG_KEEP = 3;
+
+// What the GUI thread is doing, for the watcher thread to sample.
+static Qt::HANDLE guiThread = 0;
+static QAtomicPointer<const char> tagName(0);
+static QAtomicInt tagEvent(0);
+
+/**
+ * @brief StallTag::StallTag
+ * @param name what is running, e.g. "MainWindow::dbJobFinished".  Must outlive the
+ *        program, like a string literal or a class name from a QMetaObject.
+ * @param eventType the QEvent::Type being delivered, or 0 for a named operation.
+ */
+StallTag::StallTag(const char *name, int eventType) :
+    previousName(0),
+    previousEvent(0),
+    active(guiThread != 0 && QThread::currentThreadId() == guiThread)
+{
+    if(!active)
+        return;
+
+    previousName = tagName.fetchAndStoreRelaxed(name);
+    previousEvent = tagEvent.fetchAndStoreRelaxed(eventType);
+}
+
+StallTag::~StallTag()
+{
+    if(!active)
+        return;
+
+    tagName.fetchAndStoreRelaxed(previousName);
+    tagEvent.fetchAndStoreRelaxed(previousEvent);
+}
+
+/**
+ * @brief StallWatchdog::StallWatchdog
+ * @param logPath file stalls are appended to.
+ * @param thresholdMs how late the event loop must run to count as a stall; 0 turns
+ *        the watchdog off.
+ */
+StallWatchdog::StallWatchdog(QString logPath, int thresholdMs, QObject *parent) :
+    QObject(parent),
+    logPath(logPath),
+    thresholdMs(thresholdMs > 0 ? qMax(thresholdMs, 2 * TICK_MS) : 0),
+    beats(0),
+    lastLagMs(0),
+    stopping(0),
+    stallCount(0),
+    worstMs(0)
+{
+    timer = new QTimer(this);
+    connect(timer, SIGNAL(timeout()), this, SLOT(tick()));
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    stop();
+}
+
+/**
+ * @brief StallWatchdog::start start measuring.  Call from the GUI thread, whose event
+ *        loop is the one watched.
+ */
+void StallWatchdog::start()
+{
+    if(thresholdMs <= 0 || watcher.joinable())
+        return;
+
+    guiThread = QThread::currentThreadId();
+    sinceTick.start();
+    timer->start(TICK_MS);
+    watcher = std::thread(&StallWatchdog::watch, this);
+}
+
+void StallWatchdog::stop()
+{
+    if(!watcher.joinable())
+        return;
+
+    stopping.fetchAndStoreOrdered(1);
+    watcher.join();
+    timer->stop();
+}
+
+/**
+ * @brief StallWatchdog::tick runs on the GUI thread: record how late this tick is.
+ *        The watcher takes the worst lag since it last looked.
+ */
+void StallWatchdog::tick()
+{
+    qint64 nanos = sinceTick.nsecsElapsed();
+    sinceTick.restart();
+
+    qint64 lagNanos = qMax((qint64)0, nanos - TICK_MS * 1000000LL);
+    Metrics::record(Metrics::EventLoopLag, lagNanos);
+
+    int lag = (int)qMin(lagNanos / 1000000, (qint64)INT_MAX);
+    int previous;
+    do
+    {
+        previous = lastLagMs.fetchAndAddRelaxed(0);
+    } while(lag > previous && !lastLagMs.testAndSetRelaxed(previous, lag));
+
+    beats.fetchAndAddOrdered(1);
+}
+
+/**
+ * @brief StallWatchdog::sampleCause what the GUI thread is in right now.
+ */
+QString StallWatchdog::sampleCause()
+{
+    const char *name = tagName.fetchAndAddRelaxed(0);
+    int event = tagEvent.fetchAndAddRelaxed(0);
+    if(!name)
+        return QString();
+
+    if(event == 0)
+        return name;
+
+    QString what;
+    switch(event)
+    {
+    case QEvent::Timer:
+        what = "timer";
+        break;
+    case QEvent::MouseButtonPress:
+        what = "press";
+        break;
+    case QEvent::MouseButtonRelease:
+        what = "release";
+        break;
+    case QEvent::Paint:
+        what = "paint";
+        break;
+    case QEvent::MetaCall:
+        what = "queued call";
+        break;
+    default:
+        what = QString("event %1").arg(event);
+        break;
+    }
+
+    return QString("%1 %2").arg(name).arg(what);
+}
+
+/**
+ * @brief StallWatchdog::watch the watcher thread: notice the ticks stopping, sample the
+ *        cause while they are stopped, and record the stall once they start again.
+ */
+void StallWatchdog::watch()
+{
+    int seen = beats.fetchAndAddRelaxed(0);
+    QElapsedTimer sinceBeat;
+    sinceBeat.start();
+    bool stalled = false;
+    bool hangLogged = false;
+    QString cause;
+
+    while(!stopping.fetchAndAddRelaxed(0))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_MS));
+
+        int now = beats.fetchAndAddRelaxed(0);
+        if(now != seen)
+        {
+            int lag = lastLagMs.fetchAndStoreRelaxed(0);
+            if(lag >= thresholdMs)
+                recordStall(lag, stalled ? cause : QString());
+
+            seen = now;
+            sinceBeat.restart();
+            stalled = false;
+            hangLogged = false;
+            cause.clear();
+            continue;
+        }
+
+        if(sinceBeat.elapsed() < thresholdMs)
+            continue;
+
+        // The innermost tag seen during the stall is the most specific.
+        stalled = true;
+        QString sample = sampleCause();
+        if(!sample.isEmpty())
+            cause = sample;
+
+        if(!hangLogged && sinceBeat.elapsed() >= HANG_LOG_MS)
+        {
+            appendLog(QString("%1 stalled for %2 ms so far in %3")
+                      .arg(QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss"))
+                      .arg(sinceBeat.elapsed())
+                      .arg(cause.isEmpty() ? QString("untagged work") : cause));
+            hangLogged = true;
+        }
+    }
+}
+
+void StallWatchdog::recordStall(int ms, const QString &cause)
+{
+    Stall stall;
+    stall.ended = QDateTime::currentDateTime();
+    stall.ms = ms;
+    stall.cause = cause.isEmpty() ? QString("untagged work") : cause;
+
+    Metrics::count(Metrics::UiStalls);
+    {
+        QMutexLocker locker(&lock);
+        recent.append(stall);
+        if(recent.size() > RECENT_MAX)
+            recent.removeFirst();
+
+        CauseTotals &totals = causes[stall.cause];
+        if(totals.stalls == 0)
+        {
+            totals.worstMs = 0;
+            totals.totalMs = 0;
+        }
+        totals.stalls++;
+        totals.worstMs = qMax(totals.worstMs, ms);
+        totals.totalMs += ms;
+
+        stallCount++;
+        worstMs = qMax(worstMs, ms);
+    }
+
+    appendLog(QString("%1 stall %2 ms in %3")
+              .arg(stall.ended.toString("yyyy-MM-dd hh:mm:ss"))
+              .arg(ms)
+              .arg(stall.cause));
+}
+
+/**
+ * @brief StallWatchdog::appendLog add a line to the log, rotating it first if it is too
+ *        big.  Only the watcher thread writes the log.
+ */
+void StallWatchdog::appendLog(const QString &line)
+{
+    if(QFile(logPath).size() >= LOG_MAX_BYTES)
+    {
+        QFile::remove(QString("%1.%2").arg(logPath).arg(LOG_KEEP));
+        for(int i = LOG_KEEP - 1; i >= 1; i--)
+        {
+            QFile::rename(QString("%1.%2").arg(logPath).arg(i), QString("%1.%2").arg(logPath).arg(i + 1));
+        }
+        QFile::rename(logPath, logPath + ".1");
+    }
+
+    QFile file(logPath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    {
+        qWarning() << "Could not write stall log" << logPath << ":" << file.errorString();
+        return;
+    }
+
+    file.write(line.toUtf8() + "\n");
+}
+
+/**
+ * @brief StallWatchdog::report lines for the keypad diagnostics: how many stalls there
+ *        have been, the causes that cost the most, and the latest stalls.
+ */
+QStringList StallWatchdog::report()
+{
+    QMutexLocker locker(&lock);
+    QStringList lines;
+    if(thresholdMs <= 0)
+    {
+        lines << "The stall watchdog is off.";
+        return lines;
+    }
+
+    lines << QString("Screen stalls over %1 ms: %2 since start, worst %3 ms.").arg(thresholdMs).arg(stallCount).arg(worstMs);
+    if(stallCount == 0)
+        return lines;
+
+    QList<QPair<qint64, QString> > byTotal;
+    for(QHash<QString, CauseTotals>::const_iterator it = causes.constBegin(); it != causes.constEnd(); ++it)
+    {
+        byTotal.append(qMakePair(it.value().totalMs, it.key()));
+    }
+    std::sort(byTotal.begin(), byTotal.end());
+
+    lines << "By cause (stalls, worst, total):";
+    for(int i = byTotal.size() - 1; i >= 0 && i >= byTotal.size() - REPORT_CAUSES; i--)
+    {
+        const CauseTotals &totals = causes[byTotal[i].second];
+        lines << QString("  %1, %2 ms, %3 s:\t%4").arg(totals.stalls).arg(totals.worstMs)
+                 .arg(totals.totalMs / 1000.0, 0, 'f', 1).arg(byTotal[i].second);
+    }
+
+    lines << "Latest:";
+    for(int i = recent.size() - 1; i >= 0 && i >= recent.size() - REPORT_RECENT; i--)
+    {
+        lines << QString("  %1\t%2 ms\t%3").arg(recent[i].ended.toString("hh:mm:ss")).arg(recent[i].ms).arg(recent[i].cause);
+    }
+
+    lines << "Logged to " + logPath;
+    return lines;
+}
+
+WatchedApplication::WatchedApplication(int &argc, char **argv) :
+    QApplication(argc, argv)
+{
+}
+
+/**
+ * @brief WatchedApplication::notify deliver an event under a tag naming the receiver's
+ *        class; slots tag themselves more precisely inside it.
+ */
+bool WatchedApplication::notify(QObject *receiver, QEvent *event)
+{
+    StallTag tag(receiver->metaObject()->className(), event->type());
+    return QApplication::notify(receiver, event);
+}
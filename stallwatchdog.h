@@ -0,0 +1,117 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QApplication>
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <thread>
+
+class QTimer;
+
+/**
+ * @brief The StallTag class names what the GUI thread is doing while it is in scope, so
+ *        a stall can be blamed on it.  Tags nest; the innermost one is reported.  Ignored
+ *        on every other thread, and costs next to nothing without a StallWatchdog.
+ */
+class StallTag
+{
+public:
+    explicit StallTag(const char *name, int eventType = 0);
+    ~StallTag();
+
+private:
+    const char *previousName;
+    int previousEvent;
+    bool active;
+
+    StallTag(const StallTag &);
+    StallTag &operator=(const StallTag &);
+};
+
+/**
+ * @brief The StallWatchdog class measures how late the GUI thread's event loop runs.
+ *
+ *        A timer on the GUI thread ticks every TICK_MS and records how late each tick
+ *        was.  A watcher thread notices when the ticks stop for longer than the
+ *        threshold and samples the StallTag the GUI thread is in, so the stall is blamed
+ *        on what was running while it happened.  Once the ticks resume, the stall's
+ *        length and cause are appended to a log file, rotated when it grows too big, and
+ *        kept for report(), which the kiosk shows for keypad command 999.  A stall that
+ *        has not ended after HANG_LOG_MS is logged as well.
+ */
+class StallWatchdog : public QObject
+{
+    Q_OBJECT
+
+public:
+    StallWatchdog(QString logPath, int thresholdMs, QObject *parent = 0);
+    ~StallWatchdog();
+
+    void start();
+    void stop();
+    QStringList report();
+
+private slots:
+    void tick();
+
+private:
+    /**
+     * @brief One stall that has ended.
+     */
+    struct Stall
+    {
+        QDateTime ended;
+        int ms;
+        QString cause;
+    };
+
+    /**
+     * @brief Every stall blamed on one cause.
+     */
+    struct CauseTotals
+    {
+        int stalls;
+        int worstMs;
+        qint64 totalMs;
+    };
+
+    void watch();
+    static QString sampleCause();
+    void recordStall(int ms, const QString &cause);
+    void appendLog(const QString &line);
+
+    QString logPath;
+    int thresholdMs;
+    QTimer *timer;
+    QElapsedTimer sinceTick;
+    QAtomicInt beats;
+    QAtomicInt lastLagMs;
+    QAtomicInt stopping;
+    std::thread watcher;
+
+    QMutex lock;
+    QList<Stall> recent;
+    QHash<QString, CauseTotals> causes;
+    int stallCount;
+    int worstMs;
+};
+
+/**
+ * @brief The WatchedApplication class tags every event the GUI thread delivers with the
+ *        class of its receiver, so a stall outside any explicit StallTag still names
+ *        the widget or object that was handling it.
+ */
+class WatchedApplication : public QApplication
+{
+public:
+    WatchedApplication(int &argc, char **argv);
+    bool notify(QObject *receiver, QEvent *event);
+};
+
+#endif // STALLWATCHDOG_H
@@ -0,0 +1,64 @@
+#ifndef STORAGEBACKEND_H
+#define STORAGEBACKEND_H
+
+#include <QDateTime>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVariant>
+
+/**
+ * @brief The StorageBackend class is the database engine behind DbConnection: MySQL on a
+ *        server, or an SQLite file on the kiosk itself.  It opens and sets up each
+ *        thread's connection and supplies the few pieces of SQL the engines spell
+ *        differently; the queries themselves stay with Timesheet, Roster and ColumnStore.
+ *        Set one with DbConnection::setBackend() before the first connection is opened.
+ */
+class StorageBackend
+{
+public:
+    virtual ~StorageBackend() {}
+
+    virtual QString name() const = 0;
+    virtual bool isLocal() const = 0;
+
+    /**
+     * @brief addDatabase create a named connection for one thread, not yet opened.
+     */
+    virtual QSqlDatabase addDatabase(const QString &connectionName) = 0;
+
+    /**
+     * @brief prepare set up a freshly opened connection (session settings, schema).
+     * @return false if the connection cannot be used.
+     */
+    virtual bool prepare(QSqlDatabase &db) = 0;
+
+    virtual bool hasColumn(const QSqlDatabase &db, const QString &table, const QString &column) = 0;
+
+    /**
+     * @brief today SQL for midnight at the start of today, to compare TimeIn with.
+     */
+    virtual QString today() const = 0;
+
+    /**
+     * @brief secondsBetween SQL for the whole seconds from one DATETIME to another.
+     */
+    virtual QString secondsBetween(const QString &from, const QString &to) const = 0;
+
+    /**
+     * @brief rowCrc SQL for the CRC32 of the values joined with '|', skipping NULLs, or
+     *        empty if the engine cannot compute it; see Roster::rowCrc.
+     */
+    virtual QString rowCrc(const QString &columns) const = 0;
+
+    /**
+     * @brief joinedUpdates whether UPDATE ... JOIN can close a batch of entries at once.
+     */
+    virtual bool joinedUpdates() const = 0;
+
+    /**
+     * @brief timestamp how to bind a TimeIn or TimeOut value.
+     */
+    virtual QVariant timestamp(const QDateTime &when) const = 0;
+};
+
+#endif // STORAGEBACKEND_H
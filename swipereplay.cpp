@@ -0,0 +1,554 @@
+#include "swipereplay.h"
+#include "fakenfcreader.h"
+#include "punchclient.h"
+#include "roster.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <thread>
+#include <cstdio>
+
+// Events from the reader threads waiting to be handled, as on the kiosk.
+static const int UI_EVENT_CAPACITY = 256;
+// How long to wait for the last punches to be answered once the trace has played.
+static const int DRAIN_TIMEOUT_MS = 30000;
+
+/**
+ * @brief optionValue the argument after name, or fallback if it is not given.
+ */
+static QString optionValue(const QStringList &args, const QString &name, const QString &fallback = QString())
+{
+    int i = args.indexOf(name);
+    if(i < 0 || i + 1 >= args.size())
+        return fallback;
+
+    return args[i + 1];
+}
+
+/**
+ * @brief StandInRunner::StandInRunner
+ * @param writeMs how long each punch takes, as a database round trip would.
+ */
+StandInRunner::StandInRunner(int writeMs, QObject *parent) :
+    JobRunner(parent),
+    scheduled(false),
+    writeMs(writeMs)
+{
+}
+
+void StandInRunner::start()
+{
+}
+
+void StandInRunner::submit(const DbJob &job)
+{
+    QMutexLocker locker(&lock);
+    queue.enqueue(job);
+
+    if(!scheduled)
+    {
+        scheduled = true;
+        QMetaObject::invokeMethod(this, "processQueue", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief StandInRunner::applied punches written so far, by user id.
+ */
+QHash<int, int> StandInRunner::applied()
+{
+    QMutexLocker locker(&lock);
+    return punches;
+}
+
+void StandInRunner::processQueue()
+{
+    forever
+    {
+        DbJob job;
+        {
+            QMutexLocker locker(&lock);
+            if(queue.isEmpty())
+            {
+                scheduled = false;
+                return;
+            }
+            job = queue.dequeue();
+        }
+
+        if(writeMs > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(writeMs));
+
+        DbResult result;
+        result.job = job;
+        result.success = job.type == DbJob::Toggle;
+        if(result.success)
+        {
+            QMutexLocker locker(&lock);
+            bool in = !signedIn.contains(job.userId);
+            if(in)
+                signedIn.insert(job.userId);
+            else
+                signedIn.remove(job.userId);
+            punches[job.userId]++;
+            result.lines.append(QString("User %1 signed %2.").arg(job.userId).arg(in ? "in" : "out"));
+        }
+
+        emit finished(result);
+    }
+}
+
+/**
+ * @brief SwipeReplay::SwipeReplay
+ * @param runner where the punches go; its finished() is connected here, queued.
+ */
+SwipeReplay::SwipeReplay(JobRunner *runner, QObject *parent) :
+    QObject(parent),
+    answered(0),
+    failed(0),
+    unexpected(0),
+    unknownCards(0),
+    errors(0),
+    dropped(0),
+    runner(runner),
+    uiEvents(UI_EVENT_CAPACITY),
+    drainScheduled(0),
+    total(0),
+    outstanding(0)
+{
+    connect(runner, SIGNAL(finished(DbResult)), this, SLOT(punchAnswered(DbResult)), Qt::QueuedConnection);
+}
+
+/**
+ * @brief SwipeReplay::expect record a swipe that should become a punch.  Call before
+ *        the readers start.
+ * @param dueMs when the card is presented, after startClock().
+ */
+void SwipeReplay::expect(int reader, int userId, qint64 dueMs)
+{
+    waiting[Key(reader, userId)].enqueue(dueMs);
+    total++;
+}
+
+/**
+ * @brief SwipeReplay::startClock start timing; call just before the fake readers are
+ *        created, since their swipes are due from then.
+ */
+void SwipeReplay::startClock()
+{
+    clock.start();
+}
+
+int SwipeReplay::expected() const
+{
+    return total;
+}
+
+int SwipeReplay::unanswered() const
+{
+    return total - answered;
+}
+
+void SwipeReplay::waitWhileLoggedIn()
+{
+    // Nobody logs in on a keypad here.
+}
+
+void SwipeReplay::stopWaiting()
+{
+}
+
+void SwipeReplay::postUiEvent(UiEvent::Type type, const QString &text, int userId, int reader)
+{
+    UiEvent event;
+    event.type = type;
+    event.userId = userId;
+    event.reader = reader;
+    event.text = text;
+    uiEvents.push(event);
+
+    if(drainScheduled.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "drainUiEvents", Qt::QueuedConnection);
+}
+
+/**
+ * @brief SwipeReplay::drainUiEvents punch every resolved card, as MainWindow does for a
+ *        swipe at a reader other than the kiosk's.
+ */
+void SwipeReplay::drainUiEvents()
+{
+    drainScheduled.fetchAndStoreOrdered(0);
+
+    qint64 now = clock.nsecsElapsed();
+    UiEvent event;
+    while(uiEvents.pop(event))
+    {
+        switch(event.type)
+        {
+        case UiEvent::CardDetected:
+            break;
+        case UiEvent::UserResolved:
+        {
+            Key key(event.reader, event.userId);
+            Pending p;
+            p.submitted = now;
+            p.expected = !waiting.value(key).isEmpty();
+            if(p.expected)
+            {
+                p.due = waiting[key].dequeue() * 1000000;
+                queueNanos.push_back(now - p.due);
+            }
+            else
+            {
+                unexpected++;
+                p.due = now;
+            }
+
+            inFlight[key].enqueue(p);
+            outstanding++;
+
+            DbJob job;
+            job.type = DbJob::Toggle;
+            job.userId = event.userId;
+            job.serial = -1;
+            job.reader = event.reader;
+            runner->submit(job);
+            break;
+        }
+        case UiEvent::UnknownCard:
+            unknownCards++;
+            break;
+        case UiEvent::Error:
+            errors++;
+            break;
+        }
+    }
+
+    dropped += uiEvents.takeDropped();
+}
+
+/**
+ * @brief SwipeReplay::punchAnswered time a punch against the swipe it was made for, and
+ *        finish once every expected punch is answered.
+ */
+void SwipeReplay::punchAnswered(DbResult result)
+{
+    qint64 now = clock.nsecsElapsed();
+    Key key(result.job.reader, result.job.userId);
+    if(inFlight.value(key).isEmpty())
+        return;
+
+    Pending p = inFlight[key].dequeue();
+    outstanding--;
+    jobNanos.push_back(now - p.submitted);
+    if(p.expected)
+    {
+        totalNanos.push_back(now - p.due);
+        answered++;
+    }
+
+    if(!result.success)
+        failed++;
+
+    if(answered >= total && outstanding == 0)
+        emit done();
+}
+
+/**
+ * @brief A swipe in a trace: when the card is presented, in ms from the start.
+ */
+struct TraceSwipe
+{
+    qint64 at;
+    NfcUid uid;
+    int reader;     // -1 to spread the swipes over the readers.
+};
+
+struct SwipeOrder
+{
+    bool operator()(const TraceSwipe &a, const TraceSwipe &b) const
+    {
+        return a.at < b.at;
+    }
+};
+
+/**
+ * @brief loadTrace read a trace file: one swipe per line, "<ms from start> <uid hex>
+ *        [reader]"; blank lines and lines starting with # are skipped.
+ */
+static bool loadTrace(const QString &path, QList<TraceSwipe> &trace, QString &error)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        error = "Could not open " + path;
+        return false;
+    }
+
+    QTextStream in(&file);
+    int lineNo = 0;
+    while(!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        lineNo++;
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList parts = line.split(' ', QString::SkipEmptyParts);
+        bool ok = parts.size() == 2 || parts.size() == 3;
+        TraceSwipe s;
+        s.at = ok ? parts[0].toLongLong(&ok) : 0;
+        s.uid = ok ? NfcUid::fromHex(parts[1]) : NfcUid();
+        s.reader = ok && parts.size() == 3 ? parts[2].toInt(&ok) : -1;
+        if(!ok || !s.uid.isValid() || s.at < 0)
+        {
+            error = QString("%1:%2: expected \"<ms from start> <uid hex> [reader]\"").arg(path).arg(lineNo);
+            return false;
+        }
+
+        trace.append(s);
+    }
+
+    return true;
+}
+
+/**
+ * @brief rushTrace n people swiping in once each at random over the window, at random
+ *        readers; doublePercent of them leave the card on the reader long enough to be
+ *        read twice.
+ */
+static QList<TraceSwipe> rushTrace(int n, int windowMs, int doublePercent, int readers)
+{
+    QList<TraceSwipe> trace;
+    for(int i = 1; i <= n; i++)
+    {
+        TraceSwipe s;
+        s.at = (qint64)qrand() * windowMs / ((qint64)RAND_MAX + 1);
+        s.uid.bytes.append((char)0x4c);
+        s.uid.bytes.append((char)(i >> 16));
+        s.uid.bytes.append((char)(i >> 8));
+        s.uid.bytes.append((char)i);
+        s.reader = qrand() % readers;
+        trace.append(s);
+
+        if(qrand() % 100 < doublePercent)
+        {
+            s.at += 300 + qrand() % 1200;
+            trace.append(s);
+        }
+    }
+
+    return trace;
+}
+
+/**
+ * @brief printLatency one line of p50, p99 and max, in ms.
+ */
+static void printLatency(QTextStream &out, const char *name, std::vector<qint64> nanos)
+{
+    out << QString(name).leftJustified(14);
+    if(nanos.empty())
+    {
+        out << "none\n";
+        return;
+    }
+
+    std::sort(nanos.begin(), nanos.end());
+    int n = (int)nanos.size();
+    out << "p50 " << QString::number(nanos[n * 50 / 100] / 1e6, 'f', 1) << " ms, "
+        << "p99 " << QString::number(nanos[qMin(n - 1, n * 99 / 100)] / 1e6, 'f', 1) << " ms, "
+        << "max " << QString::number(nanos[n - 1] / 1e6, 'f', 1) << " ms\n";
+}
+
+int runSwipeReplay(const QStringList &args)
+{
+    QTextStream out(stdout);
+
+    int readerCount = optionValue(args, "--readers", "1").toInt();
+    double speed = optionValue(args, "--speed", "1").toDouble();
+    int writeMs = optionValue(args, "--write-ms", "20").toInt();
+    QString address = optionValue(args, "--connect");
+    qsrand(optionValue(args, "--seed", "1").toUInt());
+
+    QList<TraceSwipe> trace;
+    QString error;
+    if(args.contains("--replay-swipes"))
+    {
+        if(!loadTrace(optionValue(args, "--replay-swipes"), trace, error))
+        {
+            out << error << "\n";
+            return 2;
+        }
+    }
+    else if(optionValue(args, "--rush").toInt() > 0 && readerCount > 0)
+    {
+        int windowMs = qMax(optionValue(args, "--over", "300").toInt() * 1000, 1);
+        trace = rushTrace(optionValue(args, "--rush").toInt(), windowMs, optionValue(args, "--double", "10").toInt(), readerCount);
+    }
+
+    if(trace.isEmpty() || readerCount <= 0 || speed <= 0)
+    {
+        out << "usage: Signin --replay-swipes TRACE | --rush N [--over SECONDS] [--double PERCENT]\n"
+            << "       [--readers R] [--speed X] [--write-ms MS] [--connect ADDRESS] [--seed S]\n";
+        return 2;
+    }
+
+    std::stable_sort(trace.begin(), trace.end(), SwipeOrder());
+
+    // Every card in the trace gets a user, numbered in the order the cards first appear,
+    // so cards resolve from the roster without a database.
+    Roster roster;
+    QList<Roster::Entry> entries;
+    QHash<QString, int> userByRfid;
+    for(int i = 0; i < trace.size(); i++)
+    {
+        QString rfid = trace[i].uid.toRfid();
+        if(userByRfid.contains(rfid))
+            continue;
+
+        Roster::Entry e;
+        e.user.id = entries.size() + 1;
+        e.user.firstName = "Swipe";
+        e.user.lastName = QString::number(e.user.id);
+        e.rfid = rfid;
+        e.crc = 0;
+        entries.append(e);
+        userByRfid.insert(rfid, e.user.id);
+    }
+    roster.restore(entries);
+
+    JobRunner *runner;
+    if(address.isEmpty())
+        runner = new StandInRunner(writeMs);
+    else
+        runner = new PunchClient(address);
+
+    QThread runnerThread;
+    runner->moveToThread(&runnerThread);
+    QObject::connect(&runnerThread, SIGNAL(started()), runner, SLOT(start()));
+    QObject::connect(&runnerThread, SIGNAL(finished()), runner, SLOT(deleteLater()));
+    runnerThread.start();
+
+    SwipeReplay replay(runner);
+    ReaderPool pool(&replay, &roster);
+
+    // Place each swipe at its reader and replay speed.  A card read again at the same
+    // reader less than REPEAT_SWIPE_MS after it was last read is ignored by the pool,
+    // so it is not expected to punch.
+    QVector<int> readerOf(trace.size());
+    QVector<qint64> dueOf(trace.size());
+    QVector<qint64> lastRead(readerCount, -1);
+    QVector<QString> lastRfid(readerCount);
+    QHash<int, int> wantByUser;
+    qint64 endMs = 0;
+    int repeats = 0;
+    int spread = 0;
+    for(int i = 0; i < trace.size(); i++)
+    {
+        const TraceSwipe &s = trace[i];
+        int r = s.reader >= 0 ? s.reader % readerCount : spread++ % readerCount;
+        qint64 due = (qint64)(s.at / speed);
+        readerOf[i] = r;
+        dueOf[i] = due;
+        endMs = qMax(endMs, due);
+
+        QString rfid = s.uid.toRfid();
+        if(rfid == lastRfid[r] && lastRead[r] >= 0 && due - lastRead[r] < ReaderPool::REPEAT_SWIPE_MS)
+        {
+            lastRead[r] = due;
+            repeats++;
+            continue;
+        }
+
+        lastRfid[r] = rfid;
+        lastRead[r] = due;
+        replay.expect(r, userByRfid.value(rfid), due);
+        wantByUser[userByRfid.value(rfid)]++;
+    }
+
+    out << trace.size() << " swipes (" << repeats << " repeats the readers should ignore) over "
+        << QString::number(endMs / 1000.0, 'f', 1) << " s at " << readerCount << " readers, "
+        << (address.isEmpty() ? QString("stand-in database, %1 ms a punch").arg(writeMs) : "daemon at " + address) << "\n";
+
+    // The fake readers time their swipes from when they are created.
+    replay.startClock();
+    QList<FakeNfcReader *> readers;
+    QVector<qint64> lastDue(readerCount, 0);
+    for(int i = 0; i < readerCount; i++)
+    {
+        FakeNfcReader *reader = new FakeNfcReader();
+        readers.append(reader);
+        pool.addReader(reader);
+    }
+
+    for(int i = 0; i < trace.size(); i++)
+    {
+        int r = readerOf[i];
+        readers[r]->addSwipe((int)(dueOf[i] - lastDue[r]), trace[i].uid);
+        lastDue[r] = dueOf[i];
+    }
+
+    QEventLoop loop;
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    QObject::connect(&deadline, SIGNAL(timeout()), &loop, SLOT(quit()));
+    QObject::connect(&replay, SIGNAL(done()), &loop, SLOT(quit()));
+    deadline.start((int)qMin(endMs + DRAIN_TIMEOUT_MS, (qint64)INT_MAX));
+
+    QElapsedTimer wall;
+    wall.start();
+    pool.start();
+    if(replay.expected() > 0)
+        loop.exec();
+    qint64 wallNanos = wall.nsecsElapsed();
+    pool.stop();
+
+    // Take what the stand-in wrote before it is deleted.
+    StandInRunner *standIn = qobject_cast<StandInRunner *>(runner);
+    QHash<int, int> applied = standIn ? standIn->applied() : QHash<int, int>();
+
+    runnerThread.quit();
+    runnerThread.wait();
+
+    printLatency(out, "queueing", replay.queueNanos);
+    printLatency(out, "punch", replay.jobNanos);
+    printLatency(out, "end to end", replay.totalNanos);
+
+    int lost = replay.unanswered();
+    out << replay.expected() << " punches expected, " << replay.answered << " answered, "
+        << lost << " lost, " << replay.unexpected << " duplicated, " << replay.failed << " failed; "
+        << replay.unknownCards << " unknown cards, " << replay.errors << " errors, "
+        << replay.dropped << " events dropped\n"
+        << QString::number(replay.answered * 1e9 / wallNanos, 'f', 1) << " punches/s\n";
+
+    int bad = lost + replay.unexpected + replay.failed + replay.errors + replay.dropped;
+    if(standIn)
+    {
+        // Each user should have been punched once for every swipe expected of them.
+        int written = 0;
+        int missing = 0;
+        int extra = 0;
+        for(QHash<int, int>::const_iterator it = applied.constBegin(); it != applied.constEnd(); ++it)
+        {
+            written += it.value();
+            extra += qMax(0, it.value() - wantByUser.value(it.key()));
+        }
+
+        for(QHash<int, int>::const_iterator it = wantByUser.constBegin(); it != wantByUser.constEnd(); ++it)
+        {
+            missing += qMax(0, it.value() - applied.value(it.key()));
+        }
+
+        out << "stand-in wrote " << written << " punches, " << missing << " missing, " << extra << " extra\n";
+        bad += missing + extra;
+    }
+
+    return bad > 0 ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#ifndef SWIPEREPLAY_H
+#define SWIPEREPLAY_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QQueue>
+#include <QSet>
+#include <QStringList>
+#include <vector>
+#include "dbworker.h"
+#include "readerpool.h"
+
+/**
+ * @brief runSwipeReplay play a trace of card swipes through ReaderPool's reader threads,
+ *        as fake readers, and report how long each punch took:
+ *        Signin --replay-swipes TRACE | --rush N [--over SECONDS] [--double PERCENT]
+ *        [--readers R] [--speed X] [--write-ms MS] [--connect ADDRESS] [--seed S].
+ *        Needs a QCoreApplication.
+ */
+int runSwipeReplay(const QStringList &args);
+
+/**
+ * @brief The StandInRunner class stands in for the database in the swipe replay: it
+ *        runs Toggle jobs one at a time, as DbWorker does, taking writeMs for each, and
+ *        keeps who is signed in and how many punches each user got in memory.
+ */
+class StandInRunner : public JobRunner
+{
+    Q_OBJECT
+
+public:
+    explicit StandInRunner(int writeMs, QObject *parent = 0);
+    void submit(const DbJob &job);
+    QHash<int, int> applied();
+
+public slots:
+    void start();
+
+private slots:
+    void processQueue();
+
+private:
+    QMutex lock;
+    QQueue<DbJob> queue;
+    bool scheduled;
+    int writeMs;
+    QSet<int> signedIn;
+    QHash<int, int> punches;    // guarded by lock.
+};
+
+/**
+ * @brief The SwipeReplay class is the SwipeSink the replay's ReaderPool reports to.  Like
+ *        MainWindow, it queues the events from the reader threads and handles them on
+ *        its own thread, punching every resolved card.  Each punch is matched to the
+ *        swipe that was expected at that reader for that user, to time it.
+ */
+class SwipeReplay : public QObject, public SwipeSink
+{
+    Q_OBJECT
+
+public:
+    SwipeReplay(JobRunner *runner, QObject *parent = 0);
+
+    void expect(int reader, int userId, qint64 dueMs);
+    void startClock();
+    int expected() const;
+    int unanswered() const;
+
+    void waitWhileLoggedIn();
+    void stopWaiting();
+    void postUiEvent(UiEvent::Type type, const QString &text = QString(), int userId = -1, int reader = 0);
+
+    std::vector<qint64> queueNanos;     // swipe due until the event is handled.
+    std::vector<qint64> jobNanos;       // punch submitted until answered.
+    std::vector<qint64> totalNanos;     // swipe due until answered.
+    int answered;
+    int failed;
+    int unexpected;     // resolved with no swipe waiting for it: a duplicate.
+    int unknownCards;
+    int errors;
+    int dropped;
+
+signals:
+    void done();
+
+private slots:
+    void drainUiEvents();
+    void punchAnswered(DbResult result);
+
+private:
+    typedef QPair<int, int> Key;    // reader, user id.
+
+    struct Pending
+    {
+        qint64 due;
+        qint64 submitted;
+        bool expected;
+    };
+
+    JobRunner *runner;
+    UiEventQueue uiEvents;
+    QAtomicInt drainScheduled;
+    QElapsedTimer clock;
+    QHash<Key, QQueue<qint64> > waiting;
+    QHash<Key, QQueue<Pending> > inFlight;
+    int total;
+    int outstanding;
+};
+
+#endif // SWIPEREPLAY_H
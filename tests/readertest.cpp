@@ -0,0 +1,199 @@
+#include <QtTest/QtTest>
+#include <QMutex>
+#include <QMutexLocker>
+#include <chrono>
+#include <thread>
+#include "readerpool.h"
+#include "fakenfcreader.h"
+#include "roster.h"
+
+// Two registered cards: a 4 byte and a 7 byte UID.
+static const char *CARD_A = "04a1b2c3";
+static const char *CARD_B = "04112233445566";
+
+// Longest a script is given to play out.
+static const int SCRIPT_TIMEOUT_MS = 15000;
+// How long to keep listening after the last swipe, for anything unexpected.
+static const int SETTLE_MS = 700;
+
+/**
+ * @brief The RecordingSink class stands in for the window: nobody is ever logged in,
+ *        and every event the readers post is kept.
+ */
+class RecordingSink : public SwipeSink
+{
+public:
+    void waitWhileLoggedIn() {}
+    void stopWaiting() {}
+
+    void postUiEvent(UiEvent::Type type, const QString &text, int userId, int reader)
+    {
+        QMutexLocker locker(&lock);
+        UiEvent event;
+        event.type = type;
+        event.text = text;
+        event.userId = userId;
+        event.reader = reader;
+        events.append(event);
+    }
+
+    /**
+     * @brief resolved the users resolved so far, in order, as "reader:userId".
+     */
+    QStringList resolved()
+    {
+        QMutexLocker locker(&lock);
+        QStringList list;
+        for(int i = 0; i < events.size(); i++)
+        {
+            if(events[i].type == UiEvent::UserResolved)
+                list << QString("%1:%2").arg(events[i].reader).arg(events[i].userId);
+        }
+
+        return list;
+    }
+
+private:
+    QMutex lock;
+    QList<UiEvent> events;
+};
+
+class ReaderTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void rfidFromUid();
+    void resolvesUsers();
+    void suppressesRepeatSwipes();
+
+private:
+    void playOut(ReaderPool &pool, RecordingSink &sink, const QList<FakeNfcReader *> &fakes, int expected);
+
+    Roster roster;
+};
+
+static Roster::Entry rosterEntry(int id, const QString &firstName, const char *uidHex)
+{
+    Roster::Entry entry;
+    entry.user.id = id;
+    entry.user.firstName = firstName;
+    entry.user.lastName = "Tester";
+    entry.rfid = NfcUid::fromHex(uidHex).toRfid();
+    entry.crc = 0;
+    return entry;
+}
+
+void ReaderTest::initTestCase()
+{
+    QList<Roster::Entry> rows;
+    rows << rosterEntry(1, "Ada", CARD_A) << rosterEntry(2, "Bob", CARD_B);
+    roster.restore(rows);
+}
+
+/**
+ * @brief ReaderTest::playOut run the pool until every fake reader has presented its
+ *        swipes and expected users were resolved, then a little longer, and stop it.
+ */
+void ReaderTest::playOut(ReaderPool &pool, RecordingSink &sink, const QList<FakeNfcReader *> &fakes, int expected)
+{
+    pool.start();
+
+    QElapsedTimer clock;
+    clock.start();
+    while(clock.elapsed() < SCRIPT_TIMEOUT_MS)
+    {
+        int remaining = 0;
+        for(int i = 0; i < fakes.size(); i++)
+        {
+            remaining += fakes[i]->remaining();
+        }
+
+        if(remaining == 0 && sink.resolved().size() >= expected)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(SETTLE_MS));
+    pool.stop();
+}
+
+/**
+ * @brief ReaderTest::rfidFromUid user.rfid is the UID as an unsigned decimal number,
+ *        most significant byte first, as the old nfc-poll printed it.
+ */
+void ReaderTest::rfidFromUid()
+{
+    QCOMPARE(NfcUid::fromHex(CARD_A).toRfid(), QString("77705923"));
+    QCOMPARE(NfcUid::fromHex(CARD_B).toRfid(), QString("1144738493519206"));
+    QCOMPARE(NfcUid::fromHex("DE AD BE EF").toRfid(), QString("3735928559"));
+    QCOMPARE(NfcUid::fromHex(CARD_B).toHex(), QString(CARD_B));
+}
+
+/**
+ * @brief ReaderTest::resolvesUsers swipes at the kiosk reader and a second reader are
+ *        resolved to their users and reported with the reader they came from.
+ */
+void ReaderTest::resolvesUsers()
+{
+    RecordingSink sink;
+    ReaderPool pool(&sink, &roster);
+
+    FakeNfcReader *kiosk = new FakeNfcReader();
+    kiosk->addSwipe(100, NfcUid::fromHex(CARD_A));
+    kiosk->addSwipe(300, NfcUid::fromHex(CARD_B));
+
+    FakeNfcReader *door = new FakeNfcReader();
+    door->addSwipe(200, NfcUid::fromHex(CARD_B));
+
+    pool.addReader(kiosk);
+    pool.addReader(door);
+
+    QList<FakeNfcReader *> fakes;
+    fakes << kiosk << door;
+    playOut(pool, sink, fakes, 3);
+
+    QStringList resolved = sink.resolved();
+    resolved.sort();
+    QCOMPARE(resolved, QStringList() << "0:1" << "0:2" << "1:2");
+}
+
+/**
+ * @brief ReaderTest::suppressesRepeatSwipes a card read again at the same reader within
+ *        REPEAT_SWIPE_MS of its last read is ignored, unless another card was read in
+ *        between, however long it is left on the reader.
+ */
+void ReaderTest::suppressesRepeatSwipes()
+{
+    RecordingSink sink;
+    ReaderPool pool(&sink, &roster);
+
+    FakeNfcReader *kiosk = new FakeNfcReader();
+    kiosk->addSwipe(100, NfcUid::fromHex(CARD_A));
+    kiosk->addSwipe(300, NfcUid::fromHex(CARD_A));  // still on the reader: ignored.
+    kiosk->addSwipe(300, NfcUid::fromHex(CARD_B));
+    kiosk->addSwipe(300, NfcUid::fromHex(CARD_A));  // another card came between.
+    kiosk->addSwipe(ReaderPool::REPEAT_SWIPE_MS + 500, NfcUid::fromHex(CARD_A));
+
+    // Left on the reader: read every 500 ms for longer than REPEAT_SWIPE_MS, then taken
+    // away long enough to count as a new swipe.
+    kiosk->addSwipe(300, NfcUid::fromHex(CARD_B));
+    for(int held = 0; held <= ReaderPool::REPEAT_SWIPE_MS + 1000; held += 500)
+    {
+        kiosk->addSwipe(500, NfcUid::fromHex(CARD_B));
+    }
+    kiosk->addSwipe(ReaderPool::REPEAT_SWIPE_MS + 500, NfcUid::fromHex(CARD_B));
+    pool.addReader(kiosk);
+
+    QList<FakeNfcReader *> fakes;
+    fakes << kiosk;
+    playOut(pool, sink, fakes, 6);
+
+    QCOMPARE(sink.resolved(), QStringList() << "0:1" << "0:2" << "0:1" << "0:1" << "0:2" << "0:2");
+}
+
+QTEST_APPLESS_MAIN(ReaderTest)
+
+#include "readertest.moc"
@@ -0,0 +1,51 @@
+#-------------------------------------------------
+#
+# Tests of the card reader path: FakeNfcReader scripts played through a
+# ReaderPool, with no database or NFC hardware; see the README.
+#
+#-------------------------------------------------
+
+QT       += core sql testlib
+QT       -= gui
+
+TARGET = signin-readertest
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += readertest.cpp\
+        ../readerpool.cpp\
+        ../nfcreader.cpp\
+        ../fakenfcreader.cpp\
+        ../dbconnection.cpp\
+        ../timesheet.cpp\
+        ../roster.cpp\
+        ../opensessions.cpp\
+        ../punchjournal.cpp\
+        ../usertotals.cpp\
+        ../metrics.cpp\
+        ../columnstore.cpp\
+        ../rollups.cpp\
+        ../mysqlbackend.cpp\
+        ../sqlitebackend.cpp
+
+HEADERS  += ../readerpool.h\
+        ../nfcreader.h\
+        ../fakenfcreader.h\
+        ../uieventqueue.h\
+        ../dbconnection.h\
+        ../timesheet.h\
+        ../roster.h\
+        ../opensessions.h\
+        ../punchjournal.h\
+        ../usertotals.h\
+        ../metrics.h\
+        ../columnstore.h\
+        ../rollups.h\
+        ../storagebackend.h\
+        ../mysqlbackend.h\
+        ../sqlitebackend.h
+
+QMAKE_CXXFLAGS += -std=c++0x
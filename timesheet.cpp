@@ -0,0 +1,1278 @@
+#include "timesheet.h"
+#include "dbconnection.h"
+#include "roster.h"
+#include "opensessions.h"
+#include "punchjournal.h"
+#include "usertotals.h"
+#include "columnstore.h"
+#include "metrics.h"
+#include <QtSql/QtSql>
+#include <QDebug>
+#include <QSet>
+#include <QTextStream>
+
+/**
+ * @brief addSeconds for use with calculating the time delta between
+ *        two QDateTime objects for the time clock calculations.
+ *        Use with QDateTime.secsTo(other) to calculate time delta.
+ * @param ts - timespan to which seconds will be added
+ * @param seconds - number of seconds to add to this timespan.
+ */
+void addSeconds(timespan &ts, int seconds)
+{
+    int days = seconds / (24 * 3600);
+    if(days > 0)
+    {
+        ts.days += days;
+        seconds -= days * (24*3600);
+    }
+
+    int hours = seconds / 3600;
+    ts.hours += hours;
+    seconds -= hours * 3600;
+
+    int minutes = seconds / 60;
+    ts.minutes += minutes;
+    seconds -= minutes*60;
+
+    ts.seconds += seconds;
+
+    while(ts.seconds>=60)
+    {
+        ts.seconds -= 60;
+        ts.minutes++;
+    }
+
+    while(ts.minutes>=60)
+    {
+        ts.minutes-=60;
+        ts.hours++;
+    }
+
+    while(ts.hours >= 24)
+    {
+        ts.hours-=24;
+        ts.days++;
+    }
+}
+
+/**
+ * @brief Conver the timespan to a string.  Only includes the days field if it is non zero.
+ * @param ts
+ * @return Human readable representation of the given timespan.
+ */
+QString toString(timespan ts)
+{
+    if(ts.days > 0)
+    {
+        return QString("%1 days, %2 hours, %3 minutes, %4 seconds").arg(ts.days).arg(ts.hours).arg(ts.minutes).arg(ts.seconds);
+    }
+
+    return QString("%1 hours, %2 minutes, %3 seconds").arg(ts.hours).arg(ts.minutes).arg(ts.seconds);
+}
+
+// Hot punch queries.  These are prepared once per connection through
+// DbConnection::prepared and reused with bound parameters.  %1 is filled in with the
+// storage backend's spelling of midnight today, and %2 of seconds between two times.
+static const char *USER_BY_ID_SQL = "SELECT FirstName, LastName FROM user WHERE id = ?";
+static const char *USER_BY_RFID_SQL = "SELECT id, FirstName, LastName FROM user WHERE rfid = ?";
+static const char *OPEN_ENTRY_SQL = "SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=? AND TimeIn>%1 AND TimeIn=TimeOut";
+// The same once --migrate has added IsOpen (TimeIn=TimeOut, generated) and its indexes.
+static const char *OPEN_ENTRY_FLAG_SQL = "SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=? AND TimeIn>%1 AND IsOpen=1";
+static const char *USER_ENTRIES_SQL = "SELECT id, TimeIn, TimeOut FROM timesheet_entry WHERE userId=?";
+
+// Per user totals for the 555 report.  Users with no entries still get a row.
+static const char *ALL_STATS_SQL =
+        "SELECT u.id, u.FirstName, u.LastName,"
+        " COALESCE(SUM(CASE WHEN e.TimeOut>e.TimeIn THEN %2 ELSE 0 END), 0),"
+        " COUNT(CASE WHEN e.id IS NOT NULL AND (e.TimeOut IS NULL OR e.TimeOut<=e.TimeIn) THEN 1 END)"
+        " FROM user u LEFT JOIN timesheet_entry e ON e.userId=u.id"
+        " GROUP BY u.id, u.FirstName, u.LastName"
+        " ORDER BY u.LastName, u.FirstName";
+
+// The same totals per user id, for filling UserTotals.
+static const char *TOTALS_SQL =
+        "SELECT userId,"
+        " COALESCE(SUM(CASE WHEN TimeOut>TimeIn THEN %2 ELSE 0 END), 0),"
+        " COUNT(CASE WHEN TimeOut>TimeIn THEN 1 END),"
+        " COUNT(CASE WHEN TimeOut IS NULL OR TimeOut<=TimeIn THEN 1 END)"
+        " FROM timesheet_entry GROUP BY userId";
+
+// One page of the CSV export: entries signed in within [from, to), after the
+// (userId, TimeIn, id) the last page ended on.  Paging on the key keeps each result
+// small, since the MySQL driver holds a whole result in memory.  The order is that of
+// user_time_idx (whose entries end in the primary key), so each page is a range scan of
+// the index that stops at the LIMIT, with no sort.  The key comparison is spelled out
+// instead of written (e.userId, e.TimeIn, e.id)>(?, ?, ?), which the SQLite in Qt 4
+// cannot parse.
+static const char *EXPORT_PAGE_SQL =
+        "SELECT e.userId, u.FirstName, u.LastName, e.id, e.TimeIn, e.TimeOut"
+        " FROM timesheet_entry e JOIN user u ON u.id=e.userId"
+        " WHERE e.TimeIn>=? AND e.TimeIn<?"
+        " AND (e.userId>? OR (e.userId=? AND (e.TimeIn>? OR (e.TimeIn=? AND e.id>?))))"
+        " ORDER BY e.userId, e.TimeIn, e.id"
+        " LIMIT 2000";
+static const int EXPORT_PAGE_ROWS = 2000;
+
+// One page of completed entries for building the Rollups, paged on id.
+static const char *ROLLUP_PAGE_SQL =
+        "SELECT id, userId, TimeIn, TimeOut FROM timesheet_entry"
+        " WHERE TimeOut>TimeIn AND TimeOut>=? AND id>?"
+        " ORDER BY id LIMIT 20000";
+static const int ROLLUP_PAGE_ROWS = 20000;
+
+// Closes one user's open entry, for backends that cannot UPDATE ... JOIN; see signOutSql.
+static const char *SIGN_OUT_SQL =
+        "UPDATE timesheet_entry SET TimeOut=? WHERE userId=? AND TimeIn=TimeOut AND TimeIn>=? AND TimeIn<=?";
+
+/**
+ * @brief backendSql fill in the parts of sql the storage backend spells its own way:
+ *        %1 becomes midnight today and %2 the seconds from TimeIn to TimeOut, with the
+ *        columns prefixed by table.
+ */
+static QString backendSql(const char *sql, const QString &table = QString())
+{
+    StorageBackend *backend = DbConnection::backend();
+    QString prefix = table.isEmpty() ? QString() : table + ".";
+    return QString(sql).replace("%1", backend->today())
+            .replace("%2", backend->secondsBetween(prefix + "TimeIn", prefix + "TimeOut"));
+}
+
+/**
+ * @brief runQuery executes a prepared query and reports connection trouble to DbConnection.
+ * @return true if the query ran.
+ */
+static bool runQuery(QSqlDatabase &db, QSqlQuery &query)
+{
+    if(query.exec())
+        return true;
+
+    DbConnection::reportError(db);
+    return false;
+}
+
+/**
+ * @brief sumEntries totals the rows of a (id, TimeIn, TimeOut) query into total.
+ *        Entries that were never signed out are counted instead of summed.
+ */
+static void sumEntries(QSqlQuery &query, UserTotal &total)
+{
+    total.seconds = 0;
+    total.completed = 0;
+    total.unclosed = 0;
+
+    while(query.next())
+    {
+        QDateTime ti = query.value(1).toDateTime();
+        QDateTime to = query.value(2).toDateTime();
+        if (to <= ti)
+        {
+            total.unclosed++;
+            continue;
+        }
+
+        total.seconds += ti.secsTo(to);
+        total.completed++;
+    }
+}
+
+/**
+ * @brief toStats the History display's view of a user's totals.
+ */
+static void toStats(const UserTotal &total, UserStats &stats)
+{
+    stats.user.id = total.userId;
+    stats.timeOn.seconds=0;
+    stats.timeOn.minutes=0;
+    stats.timeOn.hours=0;
+    stats.timeOn.days=0;
+    addSeconds(stats.timeOn, (int)total.seconds);
+    stats.notSignedOutCount = total.unclosed;
+}
+
+/**
+ * @brief csvField quote a field for CSV if it needs it.
+ */
+static QString csvField(const QString &field)
+{
+    if(!field.contains(',') && !field.contains('"') && !field.contains('\n'))
+        return field;
+
+    QString quoted = field;
+    quoted.replace("\"", "\"\"");
+    return "\"" + quoted + "\"";
+}
+
+/**
+ * @brief csvSubtotal write the subtotal line for one user of the export.
+ */
+static void csvSubtotal(QTextStream &out, const UserInfo &user, qint64 seconds)
+{
+    out << "subtotal," << user.id << "," << csvField(user.firstName) << "," << csvField(user.lastName)
+        << ",,,," << seconds << "," << QString::number(seconds / 3600.0, 'f', 2) << "\n";
+}
+
+Timesheet::Timesheet(Roster *roster, OpenSessions *sessions, PunchJournal *journal, UserTotals *totals, ColumnStore *columns, Rollups *rollups) :
+    roster(roster),
+    sessions(sessions),
+    journal(journal),
+    sharedJournal(0),
+    totals(totals),
+    columns(columns),
+    rollups(rollups)
+{
+}
+
+/**
+ * @brief Timesheet::setSharedJournal a journal another Timesheet appends to and replays,
+ *        e.g. the punch daemon's punch worker's, for a Timesheet that only answers
+ *        reports.  Nothing is written to it or replayed from it here; it is only
+ *        checked for punches the database does not have yet, so the kept totals and
+ *        rollups are not refreshed without them.
+ */
+void Timesheet::setSharedJournal(PunchJournal *journal)
+{
+    sharedJournal = journal;
+}
+
+/**
+ * @brief Timesheet::punchesPending whether any punch is journaled but not yet written to
+ *        the database, in this Timesheet's journal or the shared one.
+ */
+bool Timesheet::punchesPending()
+{
+    return (journal && journal->pendingCount() > 0) || (sharedJournal && sharedJournal->pendingCount() > 0);
+}
+
+/**
+ * @brief Timesheet::findUser look up a user by user.id.
+ * @param id user.id typed on the keypad.
+ * @param user filled in when the user exists.
+ * @return Ok, NotFound or a database error.
+ */
+Timesheet::Result Timesheet::findUser(int id, UserInfo &user)
+{
+    if(roster && roster->findById(id, user))
+        return Ok;
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery q = DbConnection::prepared(db, USER_BY_ID_SQL);
+    q.bindValue(0, id);
+    if(!runQuery(db, q))
+        return QueryFailed;
+
+    if(!q.next())
+        return NotFound;
+
+    user.id = id;
+    user.firstName = q.value(0).toString();
+    user.lastName = q.value(1).toString();
+    q.finish();
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::findUserByRfid look up the owner of a swiped card.
+ * @param rfid card id as reported by the reader.
+ * @param user filled in when a user has this card.
+ * @return Ok, NotFound or a database error.
+ */
+Timesheet::Result Timesheet::findUserByRfid(const QString &rfid, UserInfo &user)
+{
+    if(roster && roster->findByRfid(rfid, user))
+        return Ok;
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery q = DbConnection::prepared(db, USER_BY_RFID_SQL);
+    q.bindValue(0, rfid);
+    if(!runQuery(db, q))
+        return QueryFailed;
+
+    if(!q.next())
+        return NotFound;
+
+    user.id = q.value(0).toInt();
+    user.firstName = q.value(1).toString();
+    user.lastName = q.value(2).toString();
+    q.finish();
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::findOpenEntry find the entry the user signed in with today, if any.
+ * @param userId user.id
+ * @param entry filled in when the user is signed in.
+ * @return Ok, NotSignedIn or a database error.
+ */
+Timesheet::Result Timesheet::findOpenEntry(int userId, OpenEntry &entry)
+{
+    if(sessions && sessions->isLoaded())
+        return sessions->find(userId, entry) ? Ok : NotSignedIn;
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query = DbConnection::prepared(db, backendSql(DbConnection::hasOpenFlag(db) ? OPEN_ENTRY_FLAG_SQL : OPEN_ENTRY_SQL));
+    query.bindValue(0, userId);
+    if(!runQuery(db, query))
+        return QueryFailed;
+
+    if(!query.next())
+        return NotSignedIn;
+
+    entry.id = query.value(0).toInt();
+    entry.user.id = userId;
+    entry.timeIn = query.value(1).toDateTime();
+    query.finish();
+    return Ok;
+}
+
+/**
+ * @brief punchTime the kiosk clock, to the second, as stored in TimeIn/TimeOut.
+ */
+static QDateTime punchTime()
+{
+    QDateTime now = QDateTime::currentDateTime();
+    return now.addMSecs(-now.time().msec());
+}
+
+/**
+ * @brief Timesheet::signIn Clock In, unless the user is already clocked in.
+ *        With a journal, the punch is acknowledged as soon as it is on disk, even if the
+ *        database cannot be reached; it is written to timesheet_entry by replayJournal().
+ * @param userId user.id
+ * @return Ok, AlreadySignedIn or a database error.
+ */
+Timesheet::Result Timesheet::signIn(int userId)
+{
+    OpenEntry entry;
+    Result r = findOpenEntry(userId, entry);
+    if(r == Ok)
+        return AlreadySignedIn;
+    if(r != NotSignedIn && !journal)
+        return r;
+    bool known = r == NotSignedIn;
+
+    Punch punch;
+    punch.kind = Punch::SignIn;
+    punch.userId = userId;
+    punch.when = punchTime();
+
+    r = record(punch);
+    if(r != Ok)
+        return r;
+
+    if(sessions)
+    {
+        // The entry id is not known until the punch is written; the next reconcile fills it in.
+        entry.id = -1;
+        entry.user.id = userId;
+        entry.timeIn = punch.when;
+        sessions->add(entry);
+    }
+
+    if(totals)
+    {
+        // Without the open session index the write may turn out to be a duplicate.
+        if(known)
+            totals->signedIn(userId);
+        else
+            totals->invalidate(userId);
+    }
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::signOut Clock out, if the user is clocked in.
+ *        Journaled the same way as signIn().
+ * @param userId user.id
+ * @return Ok, NotSignedIn or a database error.
+ */
+Timesheet::Result Timesheet::signOut(int userId)
+{
+    OpenEntry entry;
+    Result r = findOpenEntry(userId, entry);
+    if(r == NotSignedIn)
+        return r;
+    if(r != Ok && !journal)
+        return r;
+    bool known = r == Ok;
+
+    Punch punch;
+    punch.kind = Punch::SignOut;
+    punch.userId = userId;
+    punch.when = punchTime();
+
+    r = record(punch);
+    if(r != Ok)
+        return r;
+
+    if(sessions)
+        sessions->remove(userId);
+
+    if(totals)
+    {
+        // A sign out in the same second as the sign in leaves the entry looking open.
+        if(known && entry.timeIn < punch.when)
+            totals->signedOut(userId, entry.timeIn.secsTo(punch.when));
+        else
+            totals->invalidate(userId);
+    }
+
+    if(rollups)
+    {
+        if(known && entry.timeIn < punch.when)
+            rollups->addSession(userId, entry.timeIn, punch.when);
+        else
+            rollups->invalidate(userId);
+    }
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::toggle sign the user out if they are signed in, otherwise sign them in.
+ * @param signedIn set to true if this signed the user in.
+ * @return Ok or a database error.
+ */
+Timesheet::Result Timesheet::toggle(int userId, bool &signedIn)
+{
+    OpenEntry entry;
+    Result r = findOpenEntry(userId, entry);
+    if(r == Ok)
+    {
+        signedIn = false;
+        return signOut(userId);
+    }
+
+    if(r == NotSignedIn)
+    {
+        signedIn = true;
+        return signIn(userId);
+    }
+
+    return r;
+}
+
+/**
+ * @brief Timesheet::record append a punch to the journal, or write it straight to the
+ *        database when there is no journal or it cannot be written.
+ */
+Timesheet::Result Timesheet::record(Punch &punch)
+{
+    if(journal)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = journal->append(punch);
+        Metrics::record(Metrics::JournalAppend, timer.nsecsElapsed());
+        if(ok)
+            return Ok;
+
+        Metrics::count(Metrics::JournalErrors);
+        qWarning() << journal->lastError();
+    }
+
+    QList<Punch> one;
+    one.append(punch);
+    return writePunches(one);
+}
+
+/**
+ * @brief Timesheet::replayJournal write journaled punches to timesheet_entry, oldest first,
+ *        in batches of up to maxBatch per transaction.  Stops at the first failure; the
+ *        punches stay in the journal for the next attempt.
+ * @return Ok once the journal is empty, or the error that stopped the replay.
+ */
+Timesheet::Result Timesheet::replayJournal(int maxBatch)
+{
+    if(!journal)
+        return Ok;
+
+    forever
+    {
+        QList<Punch> batch = journal->pending(maxBatch);
+        if(batch.isEmpty())
+            return Ok;
+
+        Result r = writePunches(batch);
+        if(r != Ok)
+            return r;
+
+        journal->markReplayed(batch.last().seq);
+    }
+}
+
+/**
+ * @brief signInSql a multi-row sign in for n punches, bound as (TimeIn, userId, day start).
+ *        Punch writes use the time the punch was made on the kiosk, and skip a user who
+ *        already has an entry with that TimeIn or one still open from earlier that day,
+ *        so replaying them never creates an entry twice.
+ */
+static QString signInSql(int n)
+{
+    QString rows = "SELECT ? AS TimeIn, ? AS userId, ? AS DayStart";
+    for(int i = 1; i < n; i++)
+    {
+        rows += " UNION ALL SELECT ?, ?, ?";
+    }
+
+    return "INSERT INTO timesheet_entry (TimeIn, TimeOut, userId) "
+           "SELECT p.TimeIn, p.TimeIn, p.userId FROM (" + rows + ") p "
+           "WHERE NOT EXISTS (SELECT 1 FROM timesheet_entry e WHERE e.userId=p.userId "
+           "AND (e.TimeIn=p.TimeIn OR (e.TimeIn=e.TimeOut AND e.TimeIn>=p.DayStart AND e.TimeIn<p.TimeIn)))";
+}
+
+/**
+ * @brief signOutSql a batched sign out for n punches, bound as (userId, TimeOut, day start).
+ *        Only closes an entry that is still open and was opened that day, before the punch.
+ *        Needs UPDATE ... JOIN; other backends run SIGN_OUT_SQL once per punch, which on
+ *        a local database costs no more.
+ */
+static QString signOutSql(int n)
+{
+    QString rows = "SELECT ? AS userId, ? AS TimeOut, ? AS DayStart";
+    for(int i = 1; i < n; i++)
+    {
+        rows += " UNION ALL SELECT ?, ?, ?";
+    }
+
+    return "UPDATE timesheet_entry e JOIN (" + rows + ") p ON e.userId=p.userId "
+           "SET e.TimeOut=p.TimeOut "
+           "WHERE e.TimeIn=e.TimeOut AND e.TimeIn>=p.DayStart AND e.TimeIn<=p.TimeOut";
+}
+
+/**
+ * @brief writeGroup write a group of punches in which no user appears twice, as one
+ *        multi-row insert for the sign ins and one batched update for the sign outs.
+ */
+static bool writeGroup(QSqlDatabase &db, const QList<Punch> &group)
+{
+    QList<Punch> ins;
+    QList<Punch> outs;
+    for(int i = 0; i < group.size(); i++)
+    {
+        if(group[i].kind == Punch::SignIn)
+            ins.append(group[i]);
+        else
+            outs.append(group[i]);
+    }
+
+    StorageBackend *backend = DbConnection::backend();
+    if(!ins.isEmpty())
+    {
+        QSqlQuery q = DbConnection::prepared(db, signInSql(ins.size()));
+        for(int i = 0; i < ins.size(); i++)
+        {
+            q.bindValue(i * 3, backend->timestamp(ins[i].when));
+            q.bindValue(i * 3 + 1, ins[i].userId);
+            q.bindValue(i * 3 + 2, backend->timestamp(QDateTime(ins[i].when.date())));
+        }
+
+        if(!q.exec())
+            return false;
+    }
+
+    if(!outs.isEmpty() && backend->joinedUpdates())
+    {
+        QSqlQuery q = DbConnection::prepared(db, signOutSql(outs.size()));
+        for(int i = 0; i < outs.size(); i++)
+        {
+            q.bindValue(i * 3, outs[i].userId);
+            q.bindValue(i * 3 + 1, backend->timestamp(outs[i].when));
+            q.bindValue(i * 3 + 2, backend->timestamp(QDateTime(outs[i].when.date())));
+        }
+
+        if(!q.exec())
+            return false;
+    }
+    else if(!outs.isEmpty())
+    {
+        QSqlQuery q = DbConnection::prepared(db, SIGN_OUT_SQL);
+        for(int i = 0; i < outs.size(); i++)
+        {
+            q.bindValue(0, backend->timestamp(outs[i].when));
+            q.bindValue(1, outs[i].userId);
+            q.bindValue(2, backend->timestamp(QDateTime(outs[i].when.date())));
+            q.bindValue(3, backend->timestamp(outs[i].when));
+            if(!q.exec())
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Timesheet::writePunches write punches to timesheet_entry in one transaction.
+ *        The punches are split, in order, into the longest runs in which no user punches
+ *        twice; within such a run order does not matter, so each run is written with
+ *        one statement per kind instead of one round trip per punch.  Safe to repeat.
+ */
+Timesheet::Result Timesheet::writePunches(const QList<Punch> &punches)
+{
+    MetricsTimer timer(Metrics::PunchWrite);
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    if(!db.transaction())
+    {
+        DbConnection::reportError(db);
+        return QueryFailed;
+    }
+
+    int start = 0;
+    while(start < punches.size())
+    {
+        QSet<int> users;
+        QList<Punch> group;
+        int end = start;
+        while(end < punches.size() && !users.contains(punches[end].userId))
+        {
+            users.insert(punches[end].userId);
+            group.append(punches[end]);
+            end++;
+        }
+
+        if(!writeGroup(db, group))
+        {
+            db.rollback();
+            DbConnection::reportError(db);
+            return QueryFailed;
+        }
+
+        start = end;
+    }
+
+    if(!db.commit())
+    {
+        db.rollback();
+        DbConnection::reportError(db);
+        return QueryFailed;
+    }
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::history Calculates the total time the user has spent on the clock.
+ *        Answered from UserTotals when it has the user, otherwise from the column copy
+ *        or by reading the user's entries, which also refreshes the kept totals when
+ *        nothing is still journaled.
+ * @param userId user.id
+ * @param stats totals for the user.  Only the user id is filled in for stats.user.
+ * @return Ok or a database error.
+ */
+Timesheet::Result Timesheet::history(int userId, UserStats &stats)
+{
+    UserTotal total;
+    if(totals && totals->find(userId, total))
+    {
+        toStats(total, stats);
+        return Ok;
+    }
+
+    // The column copy is refreshed first so it has everything the query would.
+    bool fromColumns = columns && columns->isLoaded() && columns->refresh() && columns->userTotal(userId, total);
+    if(fromColumns)
+    {
+        if(totals && totals->isLoaded() && !punchesPending())
+            totals->set(total);
+
+        toStats(total, stats);
+        return Ok;
+    }
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query = DbConnection::prepared(db, USER_ENTRIES_SQL);
+    query.bindValue(0, userId);
+    if(!runQuery(db, query))
+        return QueryFailed;
+
+    total.userId = userId;
+    sumEntries(query, total);
+    if(totals && totals->isLoaded() && !punchesPending())
+        totals->set(total);
+
+    toStats(total, stats);
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::listUsers all users, sorted by last name.
+ */
+Timesheet::Result Timesheet::listUsers(QList<UserInfo> &users)
+{
+    if(roster && roster->isLoaded())
+    {
+        users = roster->users();
+        return Ok;
+    }
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query(db);
+    if(!query.exec("SELECT id, FirstName, LastName FROM user ORDER BY LastName"))
+    {
+        DbConnection::reportError(db);
+        return QueryFailed;
+    }
+
+    while(query.next())
+    {
+        UserInfo user;
+        user.id = query.value(0).toInt();
+        user.firstName = query.value(1).toString();
+        user.lastName = query.value(2).toString();
+        users.append(user);
+    }
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::listOpenEntries everyone who is currently signed in, with their sign in time.
+ *        Served from the open session index and roster when both are loaded.
+ */
+Timesheet::Result Timesheet::listOpenEntries(QList<OpenEntry> &entries)
+{
+    if(sessions && sessions->isLoaded() && roster && roster->isLoaded())
+    {
+        QList<OpenEntry> open = sessions->entries();
+        bool complete = true;
+        for(int i = 0; i < open.size() && complete; i++)
+        {
+            complete = roster->findById(open[i].user.id, open[i].user);
+        }
+
+        if(complete)
+        {
+            entries = open;
+            return Ok;
+        }
+    }
+
+    return queryOpenEntries(entries);
+}
+
+/**
+ * @brief Timesheet::reconcileOpenSessions replace the open session index with the database's view.
+ *        Picks up punches made from other kiosks or by hand, and logs any drift found.
+ */
+Timesheet::Result Timesheet::reconcileOpenSessions()
+{
+    if(!sessions)
+        return Ok;
+
+    // Punches still in the journal are in the index but not the database yet.
+    if(punchesPending())
+        return Ok;
+
+    QList<OpenEntry> entries;
+    Result r = queryOpenEntries(entries);
+    if(r != Ok)
+        return r;
+
+    int drift = sessions->replaceAll(entries);
+    if(drift > 0)
+        qWarning() << "Open session index was out of date for" << drift << "users.";
+
+    return Ok;
+}
+
+Timesheet::Result Timesheet::queryOpenEntries(QList<OpenEntry> &entries)
+{
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query(db);
+    QString qstr = QString("SELECT b.id, a.id, a.FirstName, a.LastName, b.TimeIn FROM user a, timesheet_entry b ") +
+                   QString("WHERE a.id=b.userId AND b.TimeIn>") + DbConnection::backend()->today() + " AND " +
+                   (DbConnection::hasOpenFlag(db) ? "b.IsOpen=1" : "b.TimeIn=b.TimeOut");
+    if(!query.exec(qstr))
+    {
+        DbConnection::reportError(db);
+        return QueryFailed;
+    }
+
+    while(query.next())
+    {
+        OpenEntry entry;
+        entry.id = query.value(0).toInt();
+        entry.user.id = query.value(1).toInt();
+        entry.user.firstName = query.value(2).toString();
+        entry.user.lastName = query.value(3).toString();
+        entry.timeIn = query.value(4).toDateTime();
+        entries.append(entry);
+    }
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::allStats time on the clock for all users, sorted by last name.
+ *        Computed from the column copy when there is one, otherwise by the server in
+ *        one grouped pass over timesheet_entry; entries that were never signed out are
+ *        counted instead of summed, as in sumEntries.
+ */
+Timesheet::Result Timesheet::allStats(QList<UserStats> &stats)
+{
+    if(columns && columns->isLoaded() && roster && roster->isLoaded() && columns->refresh())
+    {
+        allStatsFromColumns(stats);
+        return Ok;
+    }
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if(!query.exec(backendSql(ALL_STATS_SQL, "e")))
+    {
+        DbConnection::reportError(db);
+        return QueryFailed;
+    }
+
+    while(query.next())
+    {
+        UserStats s;
+        s.user.id = query.value(0).toInt();
+        s.user.firstName = query.value(1).toString();
+        s.user.lastName = query.value(2).toString();
+        s.timeOn.seconds = 0;
+        s.timeOn.minutes = 0;
+        s.timeOn.hours = 0;
+        s.timeOn.days = 0;
+        addSeconds(s.timeOn, query.value(3).toInt());
+        s.notSignedOutCount = query.value(4).toInt();
+        stats.append(s);
+    }
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::allStatsFromColumns the 555 report from the roster and the column
+ *        copy, matching ALL_STATS_SQL: every user, sorted by name, with their totals.
+ */
+void Timesheet::allStatsFromColumns(QList<UserStats> &stats)
+{
+    QList<UserTotal> list = columns->allTotals();
+    QHash<int, int> index;
+    for(int i = 0; i < list.size(); i++)
+    {
+        index.insert(list[i].userId, i);
+    }
+
+    QList<UserInfo> users = roster->users();
+    stats.reserve(users.size());
+    for(int i = 0; i < users.size(); i++)
+    {
+        UserTotal total;
+        QHash<int, int>::const_iterator it = index.constFind(users[i].id);
+        if(it != index.constEnd())
+        {
+            total = list[it.value()];
+        }
+        else
+        {
+            total.userId = users[i].id;
+            total.seconds = 0;
+            total.completed = 0;
+            total.unclosed = 0;
+        }
+
+        UserStats s;
+        toStats(total, s);
+        s.user = users[i];
+        stats.append(s);
+    }
+}
+
+/**
+ * @brief Timesheet::queryTotals every user's totals, computed by the server in one
+ *        grouped pass.  Users without entries are left out.
+ */
+Timesheet::Result Timesheet::queryTotals(QList<UserTotal> &list)
+{
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if(!query.exec(backendSql(TOTALS_SQL)))
+    {
+        DbConnection::reportError(db);
+        return QueryFailed;
+    }
+
+    while(query.next())
+    {
+        UserTotal total;
+        total.userId = query.value(0).toInt();
+        total.seconds = query.value(1).toLongLong();
+        total.completed = query.value(2).toInt();
+        total.unclosed = query.value(3).toInt();
+        list.append(total);
+    }
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::rebuildTotals refill UserTotals from scratch.
+ *        Refuses while punches are still journaled, since the database does not have
+ *        them yet; write them out with replayJournal() first.
+ * @return Ok, or NoConnection if punches are still waiting to be written.
+ */
+Timesheet::Result Timesheet::rebuildTotals()
+{
+    if(!totals)
+        return Ok;
+
+    if(punchesPending())
+        return NoConnection;
+
+    QList<UserTotal> list;
+    Result r = queryTotals(list);
+    if(r != Ok)
+        return r;
+
+    totals->replaceAll(list);
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::verifyTotals compare the kept totals with a full recount from the
+ *        database.  Users marked stale are skipped; they are not being answered from
+ *        memory.  Like rebuildTotals(), needs the journal to be empty.
+ * @param kept the kept totals of each user that does not match...
+ * @param actual ...and, at the same index, what the database says.
+ * @return Ok, NotFound if the totals were never loaded, or a database error.
+ */
+Timesheet::Result Timesheet::verifyTotals(QList<UserTotal> &kept, QList<UserTotal> &actual)
+{
+    if(!totals || !totals->isLoaded())
+        return NotFound;
+
+    if(punchesPending())
+        return NoConnection;
+
+    QList<UserTotal> counted;
+    Result r = queryTotals(counted);
+    if(r != Ok)
+        return r;
+
+    QHash<int, UserTotal> byUser;
+    for(int i = 0; i < counted.size(); i++)
+    {
+        byUser.insert(counted[i].userId, counted[i]);
+    }
+
+    // Users the kept totals know about but the database has no entries for.
+    QList<UserTotal> known = totals->totals();
+    for(int i = 0; i < known.size(); i++)
+    {
+        if(!byUser.contains(known[i].userId))
+        {
+            UserTotal none;
+            none.userId = known[i].userId;
+            none.seconds = 0;
+            none.completed = 0;
+            none.unclosed = 0;
+            byUser.insert(none.userId, none);
+        }
+    }
+
+    for(QHash<int, UserTotal>::const_iterator it = byUser.constBegin(); it != byUser.constEnd(); ++it)
+    {
+        UserTotal mine;
+        if(!totals->find(it.key(), mine))
+            continue;
+
+        const UserTotal &theirs = it.value();
+        if(mine.seconds != theirs.seconds || mine.completed != theirs.completed || mine.unclosed != theirs.unclosed)
+        {
+            kept.append(mine);
+            actual.append(theirs);
+        }
+    }
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::exportCsv write every entry signed in from the start of from to the
+ *        end of to as CSV, one "session" line each, grouped by user with a "subtotal"
+ *        line after each user and a "total" line at the end.  Entries that were never
+ *        signed out have no time out and count for nothing.
+ *
+ *        The rows are read in pages of EXPORT_PAGE_ROWS and written through a
+ *        QTextStream as they arrive, so memory use does not grow with the range.
+ * @param rows set to the number of session lines written.
+ * @return Ok, or a database error; check the device for write errors.
+ */
+Timesheet::Result Timesheet::exportCsv(const QDate &from, const QDate &to, QIODevice *device, qint64 &rows)
+{
+    rows = 0;
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if(!query.prepare(EXPORT_PAGE_SQL))
+    {
+        DbConnection::reportError(db);
+        return QueryFailed;
+    }
+
+    QTextStream out(device);
+    out.setCodec("UTF-8");
+    out << "type,user_id,first_name,last_name,entry_id,time_in,time_out,seconds,hours\n";
+
+    UserInfo user;
+    user.id = 0;
+    qint64 userSeconds = 0;
+    qint64 allSeconds = 0;
+    int users = 0;
+    QDateTime lastTimeIn(from);
+    int lastId = 0;
+
+    for(;;)
+    {
+        query.bindValue(0, DbConnection::backend()->timestamp(QDateTime(from)));
+        query.bindValue(1, DbConnection::backend()->timestamp(QDateTime(to.addDays(1))));
+        query.bindValue(2, user.id);
+        query.bindValue(3, user.id);
+        query.bindValue(4, DbConnection::backend()->timestamp(lastTimeIn));
+        query.bindValue(5, DbConnection::backend()->timestamp(lastTimeIn));
+        query.bindValue(6, lastId);
+        if(!runQuery(db, query))
+            return QueryFailed;
+
+        int fetched = 0;
+        while(query.next())
+        {
+            fetched++;
+            int userId = query.value(0).toInt();
+            if(userId != user.id)
+            {
+                if(users > 0)
+                    csvSubtotal(out, user, userSeconds);
+
+                user.id = userId;
+                user.firstName = query.value(1).toString();
+                user.lastName = query.value(2).toString();
+                userSeconds = 0;
+                users++;
+            }
+
+            lastId = query.value(3).toInt();
+            QDateTime ti = query.value(4).toDateTime();
+            lastTimeIn = ti;
+            QDateTime timeOut = query.value(5).toDateTime();
+
+            out << "session," << user.id << "," << csvField(user.firstName) << "," << csvField(user.lastName)
+                << "," << lastId << "," << ti.toString("yyyy-MM-dd hh:mm:ss") << ",";
+            if(timeOut > ti)
+            {
+                qint64 seconds = ti.secsTo(timeOut);
+                userSeconds += seconds;
+                allSeconds += seconds;
+                out << timeOut.toString("yyyy-MM-dd hh:mm:ss") << "," << seconds << ","
+                    << QString::number(seconds / 3600.0, 'f', 2);
+            }
+            else
+            {
+                out << ",,";
+            }
+            out << "\n";
+            rows++;
+        }
+
+        query.finish();
+        if(fetched < EXPORT_PAGE_ROWS)
+            break;
+    }
+
+    if(users > 0)
+        csvSubtotal(out, user, userSeconds);
+
+    out << "total,,,,,,," << allSeconds << "," << QString::number(allSeconds / 3600.0, 'f', 2) << "\n";
+    out.flush();
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::rebuildRollups refill the Rollups from timesheet_entry, a page at a
+ *        time.  Like rebuildTotals(), refuses while punches are still journaled.
+ * @param since only entries signed out on or after this day; all of them if null.
+ * @return Ok, or NoConnection if punches are still waiting to be written.
+ */
+Timesheet::Result Timesheet::rebuildRollups(const QDate &since)
+{
+    if(!rollups)
+        return Ok;
+
+    if(punchesPending())
+        return NoConnection;
+
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if(!query.prepare(ROLLUP_PAGE_SQL))
+    {
+        DbConnection::reportError(db);
+        return QueryFailed;
+    }
+
+    Rollups built;
+    QDateTime start(since.isValid() ? since : QDate(1970, 1, 1));
+    int lastId = -1;
+    for(;;)
+    {
+        query.bindValue(0, DbConnection::backend()->timestamp(start));
+        query.bindValue(1, lastId);
+        if(!runQuery(db, query))
+            return QueryFailed;
+
+        int fetched = 0;
+        while(query.next())
+        {
+            fetched++;
+            lastId = query.value(0).toInt();
+            built.load(query.value(1).toInt(), query.value(2).toDateTime(), query.value(3).toDateTime());
+        }
+
+        query.finish();
+        if(fetched < ROLLUP_PAGE_ROWS)
+            break;
+    }
+
+    rollups->takeAll(built);
+    return Ok;
+}
+
+bool Timesheet::rollupsLoaded()
+{
+    return rollups && rollups->isLoaded();
+}
+
+/**
+ * @brief Timesheet::rangeSeconds a user's time on the clock from the start of from to
+ *        the end of to, counting completed entries only.  Answered from the Rollups,
+ *        or by reading the user's entries, which also refreshes the user's rollups
+ *        when nothing is still journaled.
+ */
+Timesheet::Result Timesheet::rangeSeconds(int userId, const QDate &from, const QDate &to, qint64 &seconds)
+{
+    if(rollups && rollups->isLoaded() && !rollups->isStale(userId))
+    {
+        seconds = rollups->seconds(userId, from, to);
+        return Ok;
+    }
+
+    QList<Rollups::Session> list;
+    Result r = userSessions(userId, list);
+    if(r != Ok)
+        return r;
+
+    Rollups one;
+    for(int i = 0; i < list.size(); i++)
+    {
+        one.load(userId, list[i].first, list[i].second);
+    }
+    seconds = one.seconds(userId, from, to);
+
+    if(rollups && rollups->isLoaded())
+        rollups->setUser(userId, list, !punchesPending());
+
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::userSessions a user's completed entries.
+ */
+Timesheet::Result Timesheet::userSessions(int userId, QList<Rollups::Session> &list)
+{
+    QSqlDatabase db = DbConnection::database();
+    if(!db.isOpen())
+        return NoConnection;
+
+    QSqlQuery query = DbConnection::prepared(db, USER_ENTRIES_SQL);
+    query.bindValue(0, userId);
+    if(!runQuery(db, query))
+        return QueryFailed;
+
+    while(query.next())
+    {
+        QDateTime ti = query.value(1).toDateTime();
+        QDateTime to = query.value(2).toDateTime();
+        if(to > ti)
+            list.append(qMakePair(ti, to));
+    }
+
+    query.finish();
+    return Ok;
+}
+
+/**
+ * @brief Timesheet::exportRollupCsv write each user's hours per day, week or month as
+ *        CSV: one line per user and period with time on the clock, for every period
+ *        that includes a day from from to to.  The Rollups must be loaded.
+ * @param rows set to the number of lines written.
+ * @return Ok, NotFound if there are no Rollups, or a database error.
+ */
+Timesheet::Result Timesheet::exportRollupCsv(Rollups::Period period, const QDate &from, const QDate &to, QIODevice *device, qint64 &rows)
+{
+    rows = 0;
+    if(!rollups || !rollups->isLoaded())
+        return NotFound;
+
+    QList<UserInfo> users;
+    Result r = listUsers(users);
+    if(r != Ok)
+        return r;
+
+    QTextStream out(device);
+    out.setCodec("UTF-8");
+    out << "user_id,first_name,last_name,period_start,seconds,hours\n";
+
+    for(int i = 0; i < users.size(); i++)
+    {
+        QList<QPair<QDate, qint64> > buckets = rollups->buckets(users[i].id, period, from, to);
+        for(int b = 0; b < buckets.size(); b++)
+        {
+            out << users[i].id << "," << csvField(users[i].firstName) << "," << csvField(users[i].lastName) << ","
+                << buckets[b].first.toString("yyyy-MM-dd") << "," << buckets[b].second << ","
+                << QString::number(buckets[b].second / 3600.0, 'f', 2) << "\n";
+            rows++;
+        }
+    }
+
+    out.flush();
+    return Ok;
+}
@@ -0,0 +1,141 @@
+#ifndef TIMESHEET_H
+#define TIMESHEET_H
+
+#include <QString>
+#include <QDateTime>
+#include <QList>
+#include "rollups.h"
+
+// TimeSpan stuff.
+// Used in calculations of time on the clock.
+struct timespan
+{
+    int seconds;
+    int minutes;
+    int hours;
+    int days;
+};
+
+void addSeconds(timespan &ts, int seconds);
+QString toString(timespan ts);
+
+// End Timespan stuff.
+
+class QIODevice;
+class Roster;
+class OpenSessions;
+class PunchJournal;
+class UserTotals;
+class ColumnStore;
+struct Punch;
+
+struct UserInfo
+{
+    int id;
+    QString firstName;
+    QString lastName;
+};
+
+/**
+ * @brief An open timesheet_entry row: signed in today and not yet signed out.
+ */
+struct OpenEntry
+{
+    int id;
+    UserInfo user;
+    QDateTime timeIn;
+};
+
+/**
+ * @brief Lifetime totals for one user.
+ */
+struct UserStats
+{
+    UserInfo user;
+    timespan timeOn;
+    int notSignedOutCount;
+};
+
+/**
+ * @brief Lifetime totals for one user, as kept by UserTotals.
+ */
+struct UserTotal
+{
+    int userId;
+    qint64 seconds;     // summed over completed entries.
+    int completed;      // entries signed out after they were signed in.
+    int unclosed;       // entries never signed out, including one open now.
+};
+
+/**
+ * @brief The Timesheet class holds the timeclock operations against the user and
+ *        timesheet_entry tables.  It has no GUI dependencies and runs on whatever
+ *        thread calls it, using that thread's DbConnection.  When given a Roster, user
+ *        lookups are answered from memory and only fall back to the database for users
+ *        the roster has not picked up yet.  When given an OpenSessions index, sign in,
+ *        sign out and status decisions are made from memory and the index is updated as
+ *        each punch commits.  When given a PunchJournal, punches are acknowledged once
+ *        they are journaled and written to the database by replayJournal(); a journal
+ *        another Timesheet replays can be set with setSharedJournal(), so this one knows
+ *        which punches the database does not have yet.  When given
+ *        UserTotals, history is answered from memory and the totals are updated as each
+ *        punch is recorded.  When given a loaded ColumnStore, the 555 report and
+ *        history the UserTotals cannot answer are computed from it instead of by a
+ *        query.  When given Rollups, hours over a range of days are added up from
+ *        them, and they are updated as each sign out is recorded.
+ */
+class Timesheet
+{
+public:
+    enum Result
+    {
+        Ok,
+        NotFound,
+        AlreadySignedIn,
+        NotSignedIn,
+        NoConnection,
+        QueryFailed
+    };
+
+    explicit Timesheet(Roster *roster = 0, OpenSessions *sessions = 0, PunchJournal *journal = 0, UserTotals *totals = 0, ColumnStore *columns = 0, Rollups *rollups = 0);
+    void setSharedJournal(PunchJournal *journal);
+
+    Result findUser(int id, UserInfo &user);
+    Result findUserByRfid(const QString &rfid, UserInfo &user);
+    Result findOpenEntry(int userId, OpenEntry &entry);
+    Result signIn(int userId);
+    Result signOut(int userId);
+    Result toggle(int userId, bool &signedIn);
+    Result history(int userId, UserStats &stats);
+    Result listUsers(QList<UserInfo> &users);
+    Result listOpenEntries(QList<OpenEntry> &entries);
+    Result allStats(QList<UserStats> &stats);
+    Result reconcileOpenSessions();
+    Result replayJournal(int maxBatch);
+    Result writePunches(const QList<Punch> &punches);
+    Result rebuildTotals();
+    Result verifyTotals(QList<UserTotal> &kept, QList<UserTotal> &actual);
+    Result exportCsv(const QDate &from, const QDate &to, QIODevice *device, qint64 &rows);
+    Result rebuildRollups(const QDate &since = QDate());
+    bool rollupsLoaded();
+    Result rangeSeconds(int userId, const QDate &from, const QDate &to, qint64 &seconds);
+    Result exportRollupCsv(Rollups::Period period, const QDate &from, const QDate &to, QIODevice *device, qint64 &rows);
+
+private:
+    Result queryOpenEntries(QList<OpenEntry> &entries);
+    Result record(Punch &punch);
+    Result queryTotals(QList<UserTotal> &list);
+    void allStatsFromColumns(QList<UserStats> &stats);
+    Result userSessions(int userId, QList<Rollups::Session> &list);
+    bool punchesPending();
+
+    Roster *roster;
+    OpenSessions *sessions;
+    PunchJournal *journal;
+    PunchJournal *sharedJournal;
+    UserTotals *totals;
+    ColumnStore *columns;
+    Rollups *rollups;
+};
+
+#endif // TIMESHEET_H
@@ -0,0 +1,99 @@
+#include "uieventqueue.h"
+
+/**
+ * @brief UiEventQueue::UiEventQueue
+ * @param capacity most events waiting at once; rounded up to a power of two.
+ */
+UiEventQueue::UiEventQueue(int capacity) :
+    enqueuePos(0),
+    dequeuePos(0),
+    dropped(0)
+{
+    int size = 2;
+    while(size < capacity)
+    {
+        size *= 2;
+    }
+
+    cells = new Cell[size];
+    mask = size - 1;
+    for(int i = 0; i < size; i++)
+    {
+        cells[i].sequence.fetchAndStoreRelaxed(i);
+    }
+}
+
+UiEventQueue::~UiEventQueue()
+{
+    delete[] cells;
+}
+
+/**
+ * @brief UiEventQueue::push add an event.  Safe to call from any thread.
+ * @return false if the queue is full; the event is dropped.
+ */
+bool UiEventQueue::push(const UiEvent &event)
+{
+    int pos = enqueuePos.fetchAndAddRelaxed(0);
+    Cell *cell;
+
+    forever
+    {
+        cell = &cells[pos & mask];
+        int seq = cell->sequence.fetchAndAddAcquire(0);
+        int diff = (int)((unsigned)seq - (unsigned)pos);
+
+        if(diff == 0)
+        {
+            // The slot is free for this position; claim the position.
+            if(enqueuePos.testAndSetRelaxed(pos, (int)((unsigned)pos + 1)))
+                break;
+
+            pos = enqueuePos.fetchAndAddRelaxed(0);
+        }
+        else if(diff < 0)
+        {
+            // The consumer has not emptied this slot since the last lap: full.
+            dropped.fetchAndAddRelaxed(1);
+            return false;
+        }
+        else
+        {
+            // Another producer took this position first.
+            pos = enqueuePos.fetchAndAddRelaxed(0);
+        }
+    }
+
+    cell->event = event;
+    cell->sequence.fetchAndStoreRelease((int)((unsigned)pos + 1));
+    return true;
+}
+
+/**
+ * @brief UiEventQueue::pop take the oldest event.  Only the GUI thread may call this.
+ * @return false if the queue is empty.
+ */
+bool UiEventQueue::pop(UiEvent &event)
+{
+    Cell *cell = &cells[dequeuePos & mask];
+    int seq = cell->sequence.fetchAndAddAcquire(0);
+    if((int)((unsigned)seq - ((unsigned)dequeuePos + 1)) < 0)
+        return false;
+
+    event = cell->event;
+    cell->event.text.clear();
+
+    // Hand the slot back to producers for the next lap.
+    cell->sequence.fetchAndStoreRelease((int)((unsigned)dequeuePos + mask + 1));
+    dequeuePos = (int)((unsigned)dequeuePos + 1);
+    return true;
+}
+
+/**
+ * @brief UiEventQueue::takeDropped
+ * @return how many events were dropped since the last call.
+ */
+int UiEventQueue::takeDropped()
+{
+    return dropped.fetchAndStoreRelaxed(0);
+}
@@ -0,0 +1,62 @@
+#ifndef UIEVENTQUEUE_H
+#define UIEVENTQUEUE_H
+
+#include <QAtomicInt>
+#include <QString>
+
+/**
+ * @brief Something a background thread wants the window to show or do.
+ */
+struct UiEvent
+{
+    enum Type
+    {
+        CardDetected,   // a card was read; no details yet.
+        UserResolved,   // the card belongs to userId, called text.
+        UnknownCard,    // no user has the RFID in text.
+        Error           // text says what went wrong.
+    };
+
+    Type type;
+    int userId;
+    int reader;     // ReaderPool index of the reader it came from; 0 is the kiosk's.
+    QString text;
+};
+
+/**
+ * @brief The UiEventQueue class is a bounded, lock-free queue of UiEvents from any number
+ *        of producer threads to the GUI thread, which is the only consumer.
+ *
+ *        Each slot carries a sequence number that says whether it is free for the
+ *        producer at a given position or holds an event for the consumer, so push() and
+ *        pop() never block or allocate.  When the queue is full push() fails and the
+ *        event is counted as dropped.
+ */
+class UiEventQueue
+{
+public:
+    explicit UiEventQueue(int capacity);
+    ~UiEventQueue();
+
+    bool push(const UiEvent &event);
+    bool pop(UiEvent &event);
+    int takeDropped();
+
+private:
+    struct Cell
+    {
+        QAtomicInt sequence;
+        UiEvent event;
+    };
+
+    Cell *cells;
+    int mask;
+    QAtomicInt enqueuePos;
+    int dequeuePos;     // consumer only.
+    QAtomicInt dropped;
+
+    UiEventQueue(const UiEventQueue &);
+    UiEventQueue &operator=(const UiEventQueue &);
+};
+
+#endif // UIEVENTQUEUE_H
@@ -0,0 +1,113 @@
+#include "usertotals.h"
+#include <QReadLocker>
+#include <QWriteLocker>
+
+UserTotals::UserTotals() :
+    loaded(false)
+{
+}
+
+/**
+ * @brief UserTotals::isLoaded
+ * @return true once the totals have been filled from the database.
+ */
+bool UserTotals::isLoaded()
+{
+    QReadLocker locker(&lock);
+    return loaded;
+}
+
+/**
+ * @brief UserTotals::find the user's totals.  A user with no entries has all zeros.
+ * @return false if the totals are not loaded or the user is stale; ask the database.
+ */
+bool UserTotals::find(int userId, UserTotal &total)
+{
+    QReadLocker locker(&lock);
+    if(!loaded || stale.contains(userId))
+        return false;
+
+    QHash<int, UserTotal>::const_iterator it = byUser.constFind(userId);
+    if(it == byUser.constEnd())
+    {
+        total.userId = userId;
+        total.seconds = 0;
+        total.completed = 0;
+        total.unclosed = 0;
+        return true;
+    }
+
+    total = it.value();
+    return true;
+}
+
+/**
+ * @brief UserTotals::totals
+ * @return the totals of every user with entries, in no particular order.
+ */
+QList<UserTotal> UserTotals::totals()
+{
+    QReadLocker locker(&lock);
+    return byUser.values();
+}
+
+/**
+ * @brief UserTotals::signedIn count a new, still open, entry.
+ */
+void UserTotals::signedIn(int userId)
+{
+    QWriteLocker locker(&lock);
+    UserTotal &total = byUser[userId];
+    total.userId = userId;
+    total.unclosed++;
+}
+
+/**
+ * @brief UserTotals::signedOut close one of the user's open entries.
+ * @param seconds time between the sign in and the sign out.
+ */
+void UserTotals::signedOut(int userId, qint64 seconds)
+{
+    QWriteLocker locker(&lock);
+    UserTotal &total = byUser[userId];
+    total.userId = userId;
+    total.seconds += seconds;
+    total.completed++;
+    if(total.unclosed > 0)
+        total.unclosed--;
+}
+
+/**
+ * @brief UserTotals::set replace one user's totals with a fresh count from the database.
+ */
+void UserTotals::set(const UserTotal &total)
+{
+    QWriteLocker locker(&lock);
+    byUser.insert(total.userId, total);
+    stale.remove(total.userId);
+}
+
+/**
+ * @brief UserTotals::invalidate stop answering for the user until set() or replaceAll().
+ */
+void UserTotals::invalidate(int userId)
+{
+    QWriteLocker locker(&lock);
+    stale.insert(userId);
+}
+
+/**
+ * @brief UserTotals::replaceAll load the totals computed by the database.
+ */
+void UserTotals::replaceAll(const QList<UserTotal> &totals)
+{
+    QWriteLocker locker(&lock);
+    byUser.clear();
+    stale.clear();
+    for(int i = 0; i < totals.size(); i++)
+    {
+        byUser.insert(totals[i].userId, totals[i]);
+    }
+
+    loaded = true;
+}
@@ -0,0 +1,43 @@
+#ifndef USERTOTALS_H
+#define USERTOTALS_H
+
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+#include <QSet>
+#include "timesheet.h"
+
+/**
+ * @brief The UserTotals class keeps each user's lifetime totals (time on the clock,
+ *        completed entries and entries never signed out) in memory, so the History
+ *        button does not have to read every timesheet_entry row for the user.
+ *
+ *        It is filled once from one grouped query and then kept up to date by the punch
+ *        path: a sign in adds an unclosed entry, and a sign out closes it and adds its
+ *        time.  A user whose punch could not be checked against the open session index
+ *        is marked stale and read from the database again.  Replace everything with
+ *        replaceAll() to rebuild.  Safe to use from any thread.
+ */
+class UserTotals
+{
+public:
+    UserTotals();
+
+    bool isLoaded();
+    bool find(int userId, UserTotal &total);
+    QList<UserTotal> totals();
+
+    void signedIn(int userId);
+    void signedOut(int userId, qint64 seconds);
+    void set(const UserTotal &total);
+    void invalidate(int userId);
+    void replaceAll(const QList<UserTotal> &totals);
+
+private:
+    QReadWriteLock lock;
+    bool loaded;
+    QHash<int, UserTotal> byUser;
+    QSet<int> stale;
+};
+
+#endif // USERTOTALS_H